@@ -9,8 +9,17 @@
 #include "pin.H"
 #include "portability.H"
 #include "histo.H"
-#include "atomic.h"
+#include "atomic.H"
 #include "instlib.H"
+#include "sfp_profile.H"
+#include "sfp_mrc.H"
+#include "sfp_heap.H"
+#include "sfp_topology.H"
+#include "sfp_numa.H"
+#include "sfp_pages.H"
+#include "sfp_rd.H"
+#include "sfp_hll.H"
+#include "sfp_cache_sim.H"
 
 using namespace std;
 using namespace histo;
@@ -42,6 +51,146 @@ using namespace INSTLIB;
 KNOB<string> KnobResultFile(KNOB_MODE_WRITEONCE, "pintool",
 			    "o", "fp.out", "specify result file name");
 
+/* knob of the binary profile file */
+KNOB<string> KnobProfileFile(KNOB_MODE_WRITEONCE, "pintool",
+			     "b", "fp.bin", "specify the binary profile file name");
+
+/* knob of the predicted miss ratio curve file */
+KNOB<string> KnobMrcFile(KNOB_MODE_WRITEONCE, "pintool",
+			 "mrc", "", "specify the miss ratio curve file name, no curves if empty");
+
+/* knob of the thread group sizes composed in the miss ratio curves */
+KNOB<string> KnobMrcGroups(KNOB_MODE_WRITEONCE, "pintool",
+			   "mrc_groups", "", "comma separated thread group sizes, powers of two below the thread count by default");
+
+/* knobs of the topology-aware footprint report, see sfp_topology.H */
+KNOB<string> KnobTopology(KNOB_MODE_WRITEONCE, "pintool",
+			  "topo", "", "cache levels as name:cpus_per_cache[:size_kb],..., no report if empty");
+KNOB<string> KnobTopologyFile(KNOB_MODE_WRITEONCE, "pintool",
+			      "topo_o", "topo.out", "specify the topology report file name");
+KNOB<string> KnobPinning(KNOB_MODE_WRITEONCE, "pintool",
+			 "pinning", "", "cpu of each thread, comma separated, instead of sched_getaffinity");
+
+/* knobs of the cache simulator running alongside, see sfp_cache_sim.H */
+KNOB<BOOL> KnobCacheSim(KNOB_MODE_WRITEONCE, "pintool",
+			"sim", "0", "simulate a multi-core cache hierarchy alongside");
+KNOB<string> KnobCacheSimFile(KNOB_MODE_WRITEONCE, "pintool",
+			      "sim_o", "cachesim.out", "specify the cache simulation result file name");
+KNOB<UINT32> KnobSimCores(KNOB_MODE_WRITEONCE, "pintool",
+			  "sim_cores", "8", "number of cores, thread t runs on core t % cores");
+KNOB<UINT32> KnobSimLlcCores(KNOB_MODE_WRITEONCE, "pintool",
+			     "sim_llc_cores", "8", "number of cores sharing a last level cache");
+KNOB<BOOL> KnobSimPrivate(KNOB_MODE_WRITEONCE, "pintool",
+			  "sim_private", "1", "simulate the private L1 and L2, or feed all accesses to the shared cache");
+KNOB<UINT32> KnobSimL1Size(KNOB_MODE_WRITEONCE, "pintool",
+			   "sim_l1", "32", "L1 size in kB, a power of two, at most 16 x sim_l1_assoc");
+KNOB<UINT32> KnobSimL1Assoc(KNOB_MODE_WRITEONCE, "pintool",
+			    "sim_l1_assoc", "8", "L1 associativity, at most 16");
+KNOB<UINT32> KnobSimL2Size(KNOB_MODE_WRITEONCE, "pintool",
+			   "sim_l2", "256", "L2 size in kB, a power of two, at most 256 x sim_l2_assoc");
+KNOB<UINT32> KnobSimL2Assoc(KNOB_MODE_WRITEONCE, "pintool",
+			    "sim_l2_assoc", "8", "L2 associativity, at most 16");
+KNOB<UINT32> KnobSimLlcSize(KNOB_MODE_WRITEONCE, "pintool",
+			    "sim_llc", "8192", "shared cache size in kB");
+KNOB<UINT32> KnobSimLlcAssoc(KNOB_MODE_WRITEONCE, "pintool",
+			     "sim_llc_assoc", "16", "shared cache associativity");
+
+/* knob of per instruction attribution */
+KNOB<BOOL> KnobPc(KNOB_MODE_WRITEONCE, "pintool",
+		  "pc", "0", "attribute the shared accesses and first touches to instructions");
+
+/* knob of the per instruction report file */
+KNOB<string> KnobPcFile(KNOB_MODE_WRITEONCE, "pintool",
+			"pc_o", "pc.out", "specify the per instruction report file name");
+
+/* knob of the number of reported instructions */
+KNOB<UINT32> KnobPcTop(KNOB_MODE_WRITEONCE, "pintool",
+		       "pc_top", "100", "number of instructions with the most shared accesses to report");
+
+/* knob of heap object attribution */
+KNOB<BOOL> KnobHeap(KNOB_MODE_WRITEONCE, "pintool",
+		    "heap", "0", "attribute the shared footprint to heap allocation sites");
+
+/* knob of the heap report file */
+KNOB<string> KnobHeapFile(KNOB_MODE_WRITEONCE, "pintool",
+			  "heap_o", "heap.out", "specify the heap allocation site report file name");
+
+/* knob of the call stack frames of an allocation site */
+KNOB<UINT32> KnobHeapFrames(KNOB_MODE_WRITEONCE, "pintool",
+			    "heap_frames", "1", "call stack frames hashed into an allocation site, more than 1 keeps a shadow call stack");
+
+/* knob of the number of reported allocation sites */
+KNOB<UINT32> KnobHeapTop(KNOB_MODE_WRITEONCE, "pintool",
+			 "heap_top", "50", "number of allocation sites with the most shared lines to report");
+
+/* knob of the coarse granularities */
+KNOB<string> KnobGrains(KNOB_MODE_WRITEONCE, "pintool",
+			"grains", "", "comma separated block sizes in bytes measured besides the cache line, e.g. 4096,2097152");
+
+/* knob of spatial utilization */
+KNOB<BOOL> KnobUtil(KNOB_MODE_WRITEONCE, "pintool",
+		    "util", "0", "track the bytes touched in every line and report the utilization by sharing degree");
+
+/* knob of the spatial utilization report file */
+KNOB<string> KnobUtilFile(KNOB_MODE_WRITEONCE, "pintool",
+			  "util_o", "util.out", "specify the spatial utilization report file name");
+
+/* knob of the NUMA page sharing analysis */
+KNOB<UINT32> KnobNuma(KNOB_MODE_WRITEONCE, "pintool",
+		      "numa", "0", "cpus per NUMA node, track the first touch owner and the sharers of every page, 0 for none");
+
+/* knob of the NUMA report file */
+KNOB<string> KnobNumaFile(KNOB_MODE_WRITEONCE, "pintool",
+			  "numa_o", "numa.out", "specify the NUMA page placement report file name");
+
+/* knob of the NUMA report length */
+KNOB<UINT32> KnobNumaTop(KNOB_MODE_WRITEONCE, "pintool",
+			 "numa_top", "50", "number of page ranges with the most remote accesses to report");
+
+/* knob of the page classification */
+KNOB<BOOL> KnobPages(KNOB_MODE_WRITEONCE, "pintool",
+		     "pages", "0", "classify every page as private, read-shared or write-shared, into the binary profile");
+
+/* knob of the page classification report file */
+KNOB<string> KnobPagesFile(KNOB_MODE_WRITEONCE, "pintool",
+			   "pages_o", "pages.out", "specify the page classification report file name");
+
+/* knob of the page classification phases */
+KNOB<UINT64> KnobPagesPhase(KNOB_MODE_WRITEONCE, "pintool",
+			    "pages_phase", "0", "accesses of a phase the pages are also classified in, 0 for the whole run only");
+
+/* knob of the per thread footprint */
+KNOB<BOOL> KnobSolo(KNOB_MODE_WRITEONCE, "pintool",
+		    "solo", "0", "measure the footprint of every thread alone, written to the result file suffixed by .solo");
+
+/* knob of the exact stack distance mode */
+KNOB<BOOL> KnobRd(KNOB_MODE_WRITEONCE, "pintool",
+		  "rd", "0", "measure the exact LRU stack distances of every thread and of the interleaved stream");
+
+/* knob of the stack distance report file */
+KNOB<string> KnobRdFile(KNOB_MODE_WRITEONCE, "pintool",
+			"rd_o", "rd.out", "specify the stack distance miss ratio file name");
+
+/* knob of the stack distance sampling rate */
+KNOB<double> KnobRdRate(KNOB_MODE_WRITEONCE, "pintool",
+			"rd_rate", "1", "fraction of the lines whose stack distances are measured");
+
+/* knob of the windowed cardinality sketches */
+KNOB<BOOL> KnobHll(KNOB_MODE_WRITEONCE, "pintool",
+		   "hll", "0", "keep HyperLogLog sketches of the lines of every thread per time bucket, into the binary profile");
+
+/* knob of the sketch precision */
+KNOB<UINT32> KnobHllPrecision(KNOB_MODE_WRITEONCE, "pintool",
+			      "hll_p", "10", "log2 of the registers of a sketch, 4 to 16");
+
+/* knob of the time bucket width */
+KNOB<UINT64> KnobHllBucket(KNOB_MODE_WRITEONCE, "pintool",
+			   "hll_bucket", "65536", "accesses of a time bucket, doubled when a thread reaches the bucket limit");
+
+/* knob of the bucket limit */
+KNOB<UINT32> KnobHllBuckets(KNOB_MODE_WRITEONCE, "pintool",
+			    "hll_buckets", "1024", "most time buckets kept per thread");
+
 /* control variable */
 LOCALVAR CONTROL control;
 
@@ -67,7 +216,10 @@ typedef struct TStampList_t {
   TStampListElement list[MAX_THREAD];
   char head;
 
-  TStampList_t() : head(-1) {
+  /* bytes of the datum touched by any thread, for the spatial utilization */
+  UINT64 touched;
+
+  TStampList_t() : head(-1), touched(0) {
     for(int i=0;i<MAX_THREAD;i++) {
       list[i].latest = 0;
       list[i].next = -1;
@@ -79,6 +231,9 @@ typedef struct TStampList_t {
 const  uint32_t              SUBLOG_BITS = 8;
 const  uint32_t              MAX_WINDOW = (65-SUBLOG_BITS)*(1<<SUBLOG_BITS);
 
+/* histogram of intervals over window lengths */
+typedef histogram<MAX_WINDOW, sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>, sublog_index_to_value<MAX_WINDOW, SUBLOG_BITS>, INT64> TWindowHisto;
+
 /* time stamp table entry, each entry is a set of time stamps */ 
 typedef struct {
   sfp_lock_t lock;
@@ -86,6 +241,7 @@ typedef struct {
 } TStampTblEntry;
 
 #include "thread_support.H"
+#include "sfp_grain.H"
 
 struct timeval start;         // start time of profiling
 struct timeval finish;        // stop time of profiling
@@ -99,11 +255,32 @@ TStamp gWalltime;
 volatile static TStamp N = 0; // trace length
 TPStamp M[MAX_THREAD];        // total memory footprint for each thread count
 
-INT64 wcount[MAX_THREAD][MAX_WINDOW];
-INT64 wcount_i[MAX_THREAD][MAX_WINDOW];
+TWindowHisto wcount[MAX_THREAD];
+TWindowHisto wcount_i[MAX_THREAD];
+
+/* reuse intervals and footprint of every thread alone, updated by the thread itself */
+TPStamp gSoloM[MAX_THREAD];
+TWindowHisto gSoloCount[MAX_THREAD];
+TWindowHisto gSoloCount_i[MAX_THREAD];
+
+/* solo curves in lines, one per thread, kept for the binary profile */
+vector<TFootprintCurve> gSoloCurves;
 
 TStampTblEntry* gStampTbl;
 
+/* the coarse granularity levels, fed the same accesses */
+vector<GRAIN_LEVEL*> gGrains;
+
+/* sfp curves in lines, kept for the topology report */
+vector<TFootprintCurve> gCurves;
+
+/* the cache simulator, NULL if not enabled */
+MULTICORE_CACHE* gCacheSim = NULL;
+
+/* the sketches of every thread, updated by the thread itself */
+hll_series gHll[HLL_MAX_THREADS];
+int gHllPrecision = 10;
+
 
 /* ===================================================================== */
 /* Routines */
@@ -113,7 +290,7 @@ TStampTblEntry* gStampTbl;
 /* ========================================================
  * SFP Algorithm Logic
  * ======================================================== */
-void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
+void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, pc_stat_t* pc, heap_site_t* site, bool write, UINT64 touched) {
 
   TStampList s;
 
@@ -141,8 +318,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
     TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
-    __sync_add_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_add_and_fetch(&wcount_i[thd_count][idx], distance);
+    wcount[thd_count].add_atomic(idx, 1);
+    wcount_i[thd_count].add_atomic(idx, distance);
 
     /* if tid is met, stop the traversal */
     if (iter == tid) {
@@ -157,8 +334,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
      * profile SI[thd_count][idx] and SI_i[thd_count][idx]
      * which is equivalent to decreasing MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    __sync_sub_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_sub_and_fetch(&wcount_i[thd_count][idx], distance);
+    wcount[thd_count].sub_atomic(idx, 1);
+    wcount_i[thd_count].sub_atomic(idx, distance);
 
   }
 
@@ -172,15 +349,42 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
     /*
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    __sync_add_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_add_and_fetch(&wcount_i[thd_count][idx] , pos-1);
+    wcount[thd_count].add_atomic(idx, 1);
+    wcount_i[thd_count].add_atomic(idx, pos-1);
 
     /* increment the corresponding the element in M,
      * because at each level of sharing, M should be different  
      */
     __sync_add_and_fetch(&M[thd_count].con, 1);
   }
+
+  /* the stack distances since the last access by tid and by any thread */
+  if ( KnobRd.Value() ) {
+    RD_Access(tid, addr, pos, iter == -1 ? 0 : s.list[tid].latest, head == -1 ? 0 : s.list[head].latest);
+  }
+
+  /* the own interval of tid, from the trace start on its first access */
+  if ( KnobSolo.Value() ) {
+    TStamp distance = ( iter == -1 ) ? pos - 1 : pos - s.list[tid].latest - 1;
+    TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
+    gSoloCount[tid][idx]++;
+    gSoloCount_i[tid][idx] += distance;
+    if ( iter == -1 ) gSoloM[tid].con++;
+  }
+
+  /* the threads that have accessed the datum, for the per instruction and heap attribution */
+  if ( pc || site ) {
+    int sharers = thd_count + 1;
+    if ( iter != -1 ) {
+      for(int j=s.list[iter].next; j!=-1; j=s.list[j].next) sharers++;
+    }
+    if ( pc ) PC_Record(pc, sharers, iter == -1, write);
+    if ( site ) HEAP_Record(site, tid, sharers, iter == -1, write);
+  }
    
+  /* the bytes touched by this access */
+  s.touched |= touched;
+
   /* update the latest access time of tid to pos */
   s.list[tid].latest = pos;
   
@@ -199,6 +403,14 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
 }
 
 
+/* byte mask of the part of [addr, addr+size) in the line at base */
+inline UINT64 TouchedBytes(ADDRINT base, ADDRINT addr, UINT32 size) {
+  ADDRINT lo = addr > base ? addr - base : 0;
+  ADDRINT hi = addr + size - base < WORDWIDTH ? addr + size - base : WORDWIDTH;
+  if ( hi <= lo ) return 0;
+  return (hi - lo == 64) ? ~(UINT64)0 : (((UINT64)1 << (hi - lo)) - 1) << lo;
+}
+
 /* ==================================================
  * Routine handling atomic trace processing
  * ================================================== */
@@ -209,6 +421,15 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
   local_stat_t* lstat = get_tls(tid);
   if( !lstat->enabled ) return;
 
+  /* the simulated caches see the same accesses as the profile */
+  if( gCacheSim ) gCacheSim->Access(tid, (ADDRINT)addr, size, (CACHE_BASE::ACCESS_TYPE)type);
+
+  /* the counters of the instruction, if attributed */
+  pc_stat_t* pc = KnobPc.Value() ? lstat->pcs.lookup((ADDRINT)ip) : NULL;
+
+  /* the allocation site of the heap object accessed, if attributed */
+  heap_site_t* site = KnobHeap.Value() ? HEAP_Find(tid, (ADDRINT)addr) : NULL;
+
   /*
    * laddr is the lowest cacheline base touched by interval [addr, addr+size]
    * raddr is the highest cacheline base touched by interval [addr, addr+size]
@@ -223,6 +444,12 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
   for( ADDRINT base_addr = laddr; base_addr < raddr; base_addr += SETWIDTH) {
     lock_acquire(&gStampTbl[SetIndex(base_addr)].lock);
   }
+  for(size_t g=0; g<gGrains.size(); g++) {
+    gGrains[g]->Lock((ADDRINT)addr, size);
+  }
+
+  /* the stack distance mode bounds the time stamp the thread draws */
+  if ( KnobRd.Value() ) RD_Begin(tid);
 
   /* atomic increment N, reserve next $size elements 
    * it has to be done after all $size elements are reserved
@@ -235,13 +462,38 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
 
     if( cur_addr < raddr ) 
     {
-      SfpImpl(set_idx, cur_addr, tid, tempN);
+      SfpImpl(set_idx, cur_addr, tid, tempN, pc, site, type == CACHE_BASE::ACCESS_TYPE_STORE,
+              KnobUtil.Value() ? TouchedBytes(cur_addr, (ADDRINT)addr, size) : 0);
     }
 
     /* release the locks on the entries associated with cur_addr */
     lock_release(&gStampTbl[set_idx].lock);
 
   }
+
+  if ( KnobRd.Value() ) RD_End(tid);
+
+  /* the lines in the thread's sketch of the time bucket */
+  if( KnobHll.Value() && tid < HLL_MAX_THREADS ) {
+    for( ADDRINT cur_addr = laddr; cur_addr < raddr; cur_addr += SETWIDTH) {
+      gHll[tid].add(tempN, cur_addr >> WORDSHIFT);
+    }
+  }
+
+  /* the same access at the coarse granularities */
+  for(size_t g=0; g<gGrains.size(); g++) {
+    gGrains[g]->Access(tid, (ADDRINT)addr, size, tempN);
+  }
+
+  /* the page owner and sharers, for the NUMA placement advice */
+  if( KnobNuma.Value() ) {
+    NUMA_Access(tid, (ADDRINT)addr, type == CACHE_BASE::ACCESS_TYPE_STORE, tempN, site);
+  }
+
+  /* the page classes, for the thread local allocation */
+  if( KnobPages.Value() ) {
+    PAGES_Access(tid, (ADDRINT)addr, type == CACHE_BASE::ACCESS_TYPE_STORE, tempN, site);
+  }
 }
 
 /* =================================================
@@ -276,6 +528,9 @@ inline void ThreadStart_hook(THREADID tid, local_stat_t* tdata) {
   if(tid) {
     activate(tid);
   }
+
+  /* where the thread is pinned, for the topology report */
+  TOPO_RecordAffinity(tid);
 }
 
 //
@@ -315,6 +570,11 @@ VOID Instruction(INS ins, VOID *v) {
     // prefixed instructions appear as predicated instructions in Pin
     //
     
+    /* the shadow call stack of the allocation sites */
+    if ( KnobHeap.Value() && KnobHeapFrames.Value() > 1 ) {
+      HEAP_InstrumentCallStack(ins);
+    }
+
     UINT32 memOperands = INS_MemoryOperandCount(ins);
     
     for (UINT32 memOp = 0; memOp < memOperands; memOp++) {
@@ -325,6 +585,7 @@ VOID Instruction(INS ins, VOID *v) {
              IARG_THREAD_ID,
              IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
              IARG_MEMORYREAD_SIZE,
+             IARG_UINT32, CACHE_BASE::ACCESS_TYPE_LOAD,
              IARG_END);
       }
       if (INS_MemoryOperandIsWritten(ins, memOp)) {
@@ -333,6 +594,7 @@ VOID Instruction(INS ins, VOID *v) {
              IARG_THREAD_ID,
              IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
              IARG_MEMORYWRITE_SIZE,
+             IARG_UINT32, CACHE_BASE::ACCESS_TYPE_STORE,
              IARG_END);
       }
     }
@@ -391,11 +653,115 @@ LOCALFUN VOID CollectLastAccesses() {
         wcount[thd_count][idx]++;
         wcount_i[thd_count][idx] += distance;
 
+        /* the last interval of thread j alone */
+        if ( KnobSolo.Value() ) {
+          gSoloCount[j][idx]++;
+          gSoloCount_i[j][idx] += distance;
+        }
+
       }
     }
   }
 }
 
+//
+// helper routine in Fini
+// to write the footprint of every thread alone, and the ratio of the largest to the mean
+//
+LOCALFUN VOID WriteSolo() {
+
+  UINT32 threads = gThreadNum < MAX_THREAD ? gThreadNum : MAX_THREAD;
+  double sum[MAX_THREAD], sum_i[MAX_THREAD];
+  gSoloCurves.assign(threads, TFootprintCurve());
+
+  string filename = KnobResultFile.Value() + ".solo";
+  ofstream out(filename.c_str());
+  out << dec << "N:" << N << " threads:" << threads << endl;
+  out << "ws";
+  for(UINT32 t=0; t<threads; t++) {
+    out << "\tt" << t;
+  }
+  out << "\tmax/mean" << endl;
+
+  for(UINT32 t=0; t<threads; t++) {
+    sum[t] = sum_i[t] = 0;
+    for(TStamp j=1; j<=sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(N+1); j++) {
+      sum[t] += gSoloCount[t][j];
+      sum_i[t] += gSoloCount_i[t][j];
+    }
+  }
+
+  for(TStamp j=1; j<=sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(N); j++) {
+    TStamp ws = sublog_index_to_value<MAX_WINDOW, SUBLOG_BITS>(j);
+    double total = 0, top = 0;
+
+    out << ws;
+    for(UINT32 t=0; t<threads; t++) {
+      double fp = gSoloM[t].con - (sum_i[t] - (ws-1)*sum[t]) / (N-ws+1);
+      sum[t] -= gSoloCount[t][j];
+      sum_i[t] -= gSoloCount_i[t][j];
+
+      out << "\t" << setprecision(12) << fp*WORDWIDTH;
+      gSoloCurves[t].push_back(ws, fp);
+      total += fp;
+      if ( fp > top ) top = fp;
+    }
+    out << "\t" << setprecision(4) << (total > 0 ? top * threads / total : 0) << endl;
+  }
+
+  out.close();
+}
+
+//
+// helper routine in Fini
+// to report the bytes actually touched of the footprint of every sharing degree
+//
+LOCALFUN VOID WriteUtilization() {
+
+  /* lines and touched bytes of the data shared by exactly k+1 threads */
+  UINT64 lines[MAX_THREAD], used[MAX_THREAD];
+  for(int k=0; k<MAX_THREAD; k++) {
+    lines[k] = used[k] = 0;
+  }
+
+  for(int i=0;i<MAP_SIZE+1;i++) {
+    for(map<ADDRINT, TStampList>::iterator iter = gStampTbl[i].set.begin(); iter!=gStampTbl[i].set.end(); iter++) {
+      const TStampList& s = iter->second;
+      int degree = 0;
+      for(int j=s.head; j!=-1; j=s.list[j].next) degree++;
+      if ( degree == 0 ) continue;
+
+      lines[degree-1]++;
+      used[degree-1] += __builtin_popcountll(s.touched);
+    }
+  }
+
+  ofstream out(KnobUtilFile.Value().c_str());
+  out << "line:" << WORDWIDTH << endl;
+  out << "degree\tlines\tbytes\tused\twaste\tutil\t>=bytes\t>=used\t>=util" << endl;
+
+  /* the columns after util are for the data shared by at least k threads, as in fp.out */
+  UINT64 cum_lines = 0, cum_used = 0;
+  vector<string> rows(MAX_THREAD);
+  for(int k=MAX_THREAD-1; k>=0; k--) {
+    cum_lines += lines[k];
+    cum_used += used[k];
+
+    stringstream row;
+    UINT64 bytes = lines[k] * WORDWIDTH;
+    row << k+1 << "\t" << lines[k] << "\t" << bytes << "\t" << used[k] << "\t" << bytes - used[k]
+        << "\t" << setprecision(4) << (bytes ? 1.0 * used[k] / bytes : 0)
+        << "\t" << cum_lines * WORDWIDTH << "\t" << cum_used
+        << "\t" << (cum_lines ? 1.0 * cum_used / (cum_lines * WORDWIDTH) : 0);
+    rows[k] = row.str();
+  }
+  for(int k=0; k<MAX_THREAD; k++) {
+    out << rows[k] << endl;
+  }
+
+  out.close();
+}
+
 //
 // routine for openning output file
 //
@@ -411,6 +777,67 @@ LOCALFUN VOID OpenOutputFile() {
 
 }
   
+//
+// dump the sfp curves and the run info in binary profile format (sfp_profile.H)
+//
+LOCALFUN VOID WriteBinaryProfile(const vector<TFootprintCurve>& curves)
+{
+  TProfileWriter writer;
+  if ( !writer.open(KnobProfileFile.Value(), N, gThreadNum) ) return;
+
+  /* one row per window, the window length then one column per sharing degree */
+  UINT32 degrees = gThreadNum < MAX_THREAD ? gThreadNum : MAX_THREAD;
+  size_t rows = curves[0].size();
+  vector<double> data(rows * (degrees+1));
+  for(size_t r=0; r<rows; r++) {
+    data[r*(degrees+1)] = curves[0].ws[r];
+    for(UINT32 i=0; i<degrees; i++) {
+      data[r*(degrees+1)+1+i] = curves[i].fp[r];
+    }
+  }
+  if ( rows ) writer.write_section(SECTION_SFP_CURVES, 0, rows, degrees+1, &data[0]);
+
+  /* the same windows with one column per thread alone, for sfp-scaling */
+  if ( !gSoloCurves.empty() && rows ) {
+    UINT32 threads = gSoloCurves.size();
+    vector<double> solo(rows * (threads+1));
+    for(size_t r=0; r<rows; r++) {
+      solo[r*(threads+1)] = gSoloCurves[0].ws[r];
+      for(UINT32 t=0; t<threads; t++) {
+        solo[r*(threads+1)+1+t] = gSoloCurves[t].fp[r];
+      }
+    }
+    writer.write_section(SECTION_SOLO_CURVES, 0, rows, threads+1, &solo[0]);
+  }
+
+  /* the page classes of the run and of every phase */
+  if ( KnobPages.Value() ) PAGES_WriteSections(writer);
+
+  /* the sketches of every thread, merged offline by sfp-hll */
+  if ( KnobHll.Value() ) {
+    vector<hll_series*> series;
+    for(UINT32 t=0; t<gThreadNum && t<HLL_MAX_THREADS; t++) series.push_back(&gHll[t]);
+    HLL_WriteSections(writer, series, gHllPrecision);
+  }
+
+  INT64 info[RUN_INFO_COLS];
+  info[RUN_INFO_ACCESSES] = N;
+  info[RUN_INFO_WALLTIME_US] = (finish.tv_sec - start.tv_sec) * 1000000LL + (finish.tv_usec - start.tv_usec);
+  writer.write_section(SECTION_RUN_INFO, 0, 1, RUN_INFO_COLS, info);
+
+  writer.close();
+}
+
+//
+// footprint in bytes of the data accessed by any thread of set in windows
+// of length ws, composed from the sharing degrees, for the topology report
+//
+LOCALFUN double GroupFootprint(UINT64 set, double ws)
+{
+  int g = __builtin_popcountll(set);
+  double share = 1.0 * g / gThreadNum;
+  return SFP_ComposeGroup(gCurves, gThreadNum, g).at(ws * share) * WORDWIDTH;
+}
 
 //
 // Fini routine, called at application exit
@@ -427,12 +854,38 @@ VOID Fini(INT32 code, VOID* v){
   /* buffer used to hold the sum of wcount and wcount_i arrays */
   double wcount_sum[MAX_THREAD], wcount_sum_i[MAX_THREAD];
 
+  /* sfp curves in lines, for the miss ratio prediction */
+  vector<TFootprintCurve> curves(MAX_THREAD);
+
   TStamp j, ws;
   int i;
   
   /* before analysis, collect the intervals left over at trace end */
   CollectLastAccesses();
 
+  /* the instructions creating the shared footprint */
+  if ( KnobPc.Value() ) {
+    vector<const pc_table*> tables;
+    for(unsigned int t=0; t<gThreadNum; t++) tables.push_back(&get_tls(t)->pcs);
+    PC_WriteReport(KnobPcFile.Value(), tables, KnobPcTop.Value());
+  }
+
+  /* the heap allocation sites creating the shared footprint */
+  if ( KnobHeap.Value() ) {
+    HEAP_WriteReport(KnobHeapFile.Value(), KnobHeapTop.Value(), WORDWIDTH);
+  }
+
+  /* the remote accesses under first touch placement and the advice per page range and site */
+  if ( KnobNuma.Value() ) {
+    NUMA_WriteReport(KnobNumaFile.Value(), KnobNumaTop.Value());
+  }
+
+  /* the private and shared pages per phase and allocation site, the map goes to the binary profile */
+  if ( KnobPages.Value() ) {
+    PAGES_Finish();
+    PAGES_WriteReport(KnobPagesFile.Value());
+  }
+
   /* clean up the allocated thread local data */
   ThreadEnd();
 
@@ -476,7 +929,8 @@ VOID Fini(INT32 code, VOID* v){
 
       /* one column for each sharing degree */
       ResultFile << "\t" << setprecision(12) << sfp[i]*WORDWIDTH;
-      
+
+      curves[i].push_back(ws, sfp[i]);
     }
 
     ResultFile << endl;
@@ -484,6 +938,58 @@ VOID Fini(INT32 code, VOID* v){
 
   ResultFile.close();  
 
+  /* the footprint of every thread alone */
+  if ( KnobSolo.Value() ) {
+    WriteSolo();
+  }
+
+  /* the curves of the coarse granularities, in files suffixed by the block size */
+  for(size_t g=0; g<gGrains.size(); g++) {
+    gGrains[g]->Finish(N);
+    gGrains[g]->Write(KnobResultFile.Value(), N, gWalltime);
+    delete gGrains[g];
+  }
+  gGrains.clear();
+
+  /* predict the shared cache miss ratios from the sfp curves */
+  for(i=0;i<MAX_THREAD;i++) {
+    curves[i].accesses = N;
+  }
+  if ( !KnobMrcFile.Value().empty() ) {
+    SFP_WriteMrc(KnobMrcFile.Value(), curves, gThreadNum,
+                 SFP_ParseGroups(KnobMrcGroups.Value(), gThreadNum), WORDWIDTH);
+  }
+
+  /* the exact miss ratios beside the predicted ones */
+  if ( KnobRd.Value() ) {
+    RD_WriteReport(KnobRdFile.Value(), curves[0], gThreadNum, WORDWIDTH);
+  }
+
+  /* the same curves for the offline readers */
+  WriteBinaryProfile(curves);
+
+  /* the bytes actually touched of the footprint, by sharing degree */
+  if ( KnobUtil.Value() ) {
+    WriteUtilization();
+  }
+
+  /* the footprint each cache of the topology sees under the pinning of the run */
+  if( !KnobTopology.Value().empty() ) {
+    vector<double> windows;
+    for(TStamp w=1<<10; w<=N; w*=4) {
+      windows.push_back(w);
+    }
+    gCurves = curves;
+    if( !KnobPinning.Value().empty() ) TOPO_SetPinning(KnobPinning.Value());
+    TOPO_WriteReport(KnobTopologyFile.Value(), KnobTopology.Value(), gThreadNum, windows, GroupFootprint);
+  }
+
+  /* validate the prediction against the simulated caches */
+  if( gCacheSim ) {
+    gCacheSim->Report(KnobCacheSimFile.Value(), curves, gThreadNum);
+    delete gCacheSim;
+  }
+
   /* deallocate the global stamp table */
   delete[] gStampTbl;
 
@@ -519,6 +1025,53 @@ int main(int argc, char *argv[])
     for(TStamp i=0; i<(MAP_SIZE+1); i++)
       lock_release(&gStampTbl[i].lock);
 
+    /* setup the cache simulator */
+    if( KnobCacheSim.Value() ) {
+      string error = MULTICORE_CACHE::Check(KnobSimCores.Value(), KnobSimLlcCores.Value(), KnobSimPrivate.Value(),
+                                            KnobSimL1Size.Value()*KILO, KnobSimL1Assoc.Value(),
+                                            KnobSimL2Size.Value()*KILO, KnobSimL2Assoc.Value(),
+                                            KnobSimLlcSize.Value()*KILO, KnobSimLlcAssoc.Value(), WORDWIDTH);
+      if ( !error.empty() ) {
+        cerr << "cache simulator: " << error << endl;
+        return Usage();
+      }
+      gCacheSim = new MULTICORE_CACHE(KnobSimCores.Value(), KnobSimLlcCores.Value(), KnobSimPrivate.Value(),
+                                      KnobSimL1Size.Value()*KILO, KnobSimL1Assoc.Value(),
+                                      KnobSimL2Size.Value()*KILO, KnobSimL2Assoc.Value(),
+                                      KnobSimLlcSize.Value()*KILO, KnobSimLlcAssoc.Value(), WORDWIDTH);
+    }
+
+    /* the coarse granularity levels */
+    gGrains = GRAIN_ParseLevels(KnobGrains.Value(), WORDSHIFT, 64 - __builtin_clzll(MAP_SIZE));
+
+    /* hook the allocators for the heap attribution */
+    if ( KnobHeap.Value() ) {
+      HEAP_Init(KnobHeapFrames.Value());
+    }
+
+    /* the page table of the NUMA analysis */
+    if ( KnobNuma.Value() ) {
+      NUMA_Init(KnobNuma.Value(), KnobPinning.Value());
+    }
+
+    /* the sketches of the threads */
+    if ( KnobHll.Value() ) {
+      gHllPrecision = min(max((int)KnobHllPrecision.Value(), 4), 16);
+      for(int t=0; t<HLL_MAX_THREADS; t++) {
+        gHll[t].init(gHllPrecision, KnobHllBucket.Value(), KnobHllBuckets.Value());
+      }
+    }
+
+    /* the stacks of the exact stack distance mode */
+    if ( KnobRd.Value() ) {
+      RD_Init(KnobRdRate.Value());
+    }
+
+    /* the page table of the page classification */
+    if ( KnobPages.Value() ) {
+      PAGES_Init(KnobPagesPhase.Value());
+    }
+
     /* check for knobs if region instrumentation is involved */
     control.RegisterHandler(ControlHandler, 0, FALSE);
     control.Activate();
@@ -5,12 +5,17 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <string.h>
+#include <vector>
+#include <algorithm>
 
 #include "pin.H"
 #include "portability.H"
 #include "histo.H"
-#include "atomic.h"
+#include "atomic.H"
 #include "instlib.H"
+#include "sfp_mrc.H"
+#include "sfp_heap.H"
+#include "rdtsc.H"
 
 using namespace std;
 using namespace histo;
@@ -43,6 +48,98 @@ using namespace INSTLIB;
 KNOB<string> KnobResultFile(KNOB_MODE_WRITEONCE, "pintool",
 			    "o", "fp.out", "specify result file name");
 
+/* knob of the predicted miss ratio curve file */
+KNOB<string> KnobMrcFile(KNOB_MODE_WRITEONCE, "pintool",
+			 "mrc", "", "specify the miss ratio curve file name, no curves if empty");
+
+/* knob of the thread group sizes composed in the miss ratio curves */
+KNOB<string> KnobMrcGroups(KNOB_MODE_WRITEONCE, "pintool",
+			   "mrc_groups", "", "comma separated thread group sizes, powers of two below the thread count by default");
+
+/* knob of false sharing detection */
+KNOB<BOOL> KnobFalseSharing(KNOB_MODE_WRITEONCE, "pintool",
+			    "fs", "0", "classify the inter-thread line transfers into true and false sharing");
+
+/* knob of the false sharing report file */
+KNOB<string> KnobFalseSharingFile(KNOB_MODE_WRITEONCE, "pintool",
+				  "fs_o", "fs.out", "specify the false sharing report file name");
+
+/* knob of the number of reported lines */
+KNOB<UINT32> KnobFalseSharingTop(KNOB_MODE_WRITEONCE, "pintool",
+				 "fs_top", "32", "number of most falsely shared lines to report");
+
+/* knob of the granularity of the access masks */
+KNOB<UINT32> KnobFalseSharingGrain(KNOB_MODE_WRITEONCE, "pintool",
+				   "fs_grain", "1", "granularity of the access masks in bytes, 1 or 8");
+
+/* knob of ownership transfer counting */
+KNOB<BOOL> KnobPingPong(KNOB_MODE_WRITEONCE, "pintool",
+			"pp", "0", "count the ownership transfers of lines and report the most contended lines");
+
+/* knob of the ping-pong report file */
+KNOB<string> KnobPingPongFile(KNOB_MODE_WRITEONCE, "pintool",
+			      "pp_o", "pingpong.out", "specify the ping-pong report file name");
+
+/* knob of the number of tracked and reported lines */
+KNOB<UINT32> KnobPingPongTop(KNOB_MODE_WRITEONCE, "pintool",
+			     "pp_top", "32", "number of most contended lines kept by every thread and reported");
+
+/* knob of per instruction attribution */
+KNOB<BOOL> KnobPc(KNOB_MODE_WRITEONCE, "pintool",
+		  "pc", "0", "attribute the shared accesses and first touches to instructions");
+
+/* knob of the per instruction report file */
+KNOB<string> KnobPcFile(KNOB_MODE_WRITEONCE, "pintool",
+			"pc_o", "pc.out", "specify the per instruction report file name");
+
+/* knob of the number of reported instructions */
+KNOB<UINT32> KnobPcTop(KNOB_MODE_WRITEONCE, "pintool",
+		       "pc_top", "100", "number of instructions with the most shared accesses to report");
+
+/* knob of heap object attribution */
+KNOB<BOOL> KnobHeap(KNOB_MODE_WRITEONCE, "pintool",
+		    "heap", "0", "attribute the shared footprint to heap allocation sites");
+
+/* knob of the heap report file */
+KNOB<string> KnobHeapFile(KNOB_MODE_WRITEONCE, "pintool",
+			  "heap_o", "heap.out", "specify the heap allocation site report file name");
+
+/* knob of the call stack frames of an allocation site */
+KNOB<UINT32> KnobHeapFrames(KNOB_MODE_WRITEONCE, "pintool",
+			    "heap_frames", "1", "call stack frames hashed into an allocation site, more than 1 keeps a shadow call stack");
+
+/* knob of the number of reported allocation sites */
+KNOB<UINT32> KnobHeapTop(KNOB_MODE_WRITEONCE, "pintool",
+			 "heap_top", "50", "number of allocation sites with the most shared lines to report");
+
+/* knob of the dirty footprint */
+KNOB<BOOL> KnobDirty(KNOB_MODE_WRITEONCE, "pintool",
+		     "dirty", "0", "measure the dirty footprint and estimate the fill and write-back bandwidth");
+
+/* knob of the bandwidth report file */
+KNOB<string> KnobBandwidthFile(KNOB_MODE_WRITEONCE, "pintool",
+			       "bw_o", "bw.out", "specify the bandwidth report file name");
+
+/* knob of the access rate of the uninstrumented program */
+KNOB<double> KnobBandwidthRate(KNOB_MODE_WRITEONCE, "pintool",
+			       "bw_rate", "0", "accesses per second of the uninstrumented program, 0 for the rate of the profiled run");
+
+/* knob of the time stamp counter frequency */
+KNOB<double> KnobTscGhz(KNOB_MODE_WRITEONCE, "pintool",
+			"tsc_ghz", "0", "time stamp counter frequency in GHz converting the RDTSC time of the run, 0 to read it from CPUID or calibrate it at startup");
+
+/* knob of the producer-consumer communication matrix */
+KNOB<BOOL> KnobComm(KNOB_MODE_WRITEONCE, "pintool",
+		    "comm", "0", "count the lines read by each thread first after a write by another thread");
+
+/* knob of the communication matrix file */
+KNOB<string> KnobCommFile(KNOB_MODE_WRITEONCE, "pintool",
+			  "comm_o", "comm.out", "specify the communication matrix file name");
+
+/* knob of the communication matrix phases */
+KNOB<UINT64> KnobCommPhase(KNOB_MODE_WRITEONCE, "pintool",
+			   "comm_phase", "0", "accesses of a phase the communication is also split in, 0 for the whole run only");
+
 /* control variable */
 LOCALVAR CONTROL control;
 
@@ -68,8 +165,14 @@ typedef struct TStampList_t {
   TStampListElement list[MAX_THREAD];
   char head;
   TStamp last_write;
+  char last_writer;
+
+  /* reads, writes and ownership transfers of the datum */
+  UINT32 reads;
+  UINT32 writes;
+  UINT32 transfers;
 
-  TStampList_t() : head(-1), last_write(0) {
+  TStampList_t() : head(-1), last_write(0), last_writer(-1), reads(0), writes(0), transfers(0) {
     for(int i=0;i<MAX_THREAD;i++) {
       list[i].latest = 0;
       list[i].next = -1;
@@ -77,6 +180,27 @@ typedef struct TStampList_t {
   }
 } TStampList;
 
+/* false sharing record of a cache line
+ *
+ * A thread holds a valid copy of the line from its access until another
+ * thread writes the line. The next access of a thread whose copy was
+ * invalidated is a transfer; it is true sharing if it touches a byte
+ * written by the other threads since the invalidation, false sharing
+ * otherwise.
+ */
+typedef struct TSharingRecord_t {
+  UINT64 touched;               /* threads that accessed the line */
+  UINT64 writers;               /* threads that wrote the line */
+  UINT64 valid;                 /* threads holding a valid copy */
+  UINT64 remote[MAX_THREAD];    /* bytes written by others since the copy of a thread was invalidated */
+  UINT64 true_sharing;          /* transfers of written bytes */
+  UINT64 false_sharing;         /* transfers of bytes that no other thread wrote */
+
+  TSharingRecord_t() : touched(0), writers(0), valid(0), true_sharing(0), false_sharing(0) {
+    memset(remote, 0, sizeof(remote));
+  }
+} TSharingRecord;
+
 /* access type */
 enum TAccessType {
   READ_ACCESS = 0,
@@ -97,10 +221,15 @@ enum TOutputType {
 const  uint32_t              SUBLOG_BITS = 8;
 const  uint32_t              MAX_WINDOW = (65-SUBLOG_BITS)*(1<<SUBLOG_BITS);
 
+/* histogram of intervals over window lengths */
+typedef histogram<MAX_WINDOW, sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>, sublog_index_to_value<MAX_WINDOW, SUBLOG_BITS>, INT64> TWindowHisto;
+
 /* time stamp table entry, each entry is a set of time stamps */ 
 typedef struct {
   sfp_lock_t lock;
   map<ADDRINT, TStampList> set;
+  map<ADDRINT, TSharingRecord> fs;
+  map<ADDRINT, TStampList> dirty;
 } TStampTblEntry;
 
 #include "thread_support.H"
@@ -116,19 +245,38 @@ struct timeval finish;        // stop time of profiling
  */
 ofstream ResultFile[3];
 
+/* the dirty footprint, the data written in a window, by sharing degree */
+ofstream DirtyFile;
+
 /* the global wall time */
 TStamp gWalltime;
 
 volatile static TStamp N = 0; // trace length
 TPStamp M[MAX_THREAD];        // total memory footprint for each thread count
 
-INT64 wcount[MAX_THREAD][MAX_WINDOW];
-INT64 wcount_i[MAX_THREAD][MAX_WINDOW];
-INT64 wcount_ro[MAX_THREAD][MAX_WINDOW];
-INT64 wcount_ro_i[MAX_THREAD][MAX_WINDOW];
+TWindowHisto wcount[MAX_THREAD];
+TWindowHisto wcount_i[MAX_THREAD];
+TWindowHisto wcount_ro[MAX_THREAD];
+TWindowHisto wcount_ro_i[MAX_THREAD];
+
+/* intervals between the writes of a datum, for the dirty footprint */
+TPStamp M_d[MAX_THREAD];
+TWindowHisto wcount_d[MAX_THREAD];
+TWindowHisto wcount_d_i[MAX_THREAD];
+
+/* time stamp counter at start and end of profiling */
+UINT64 gStartTsc, gEndTsc;
+
+/* the TSC frequency in GHz and where it came from, set in main */
+double gTscGhz = 0;
+const char* gTscSource = "given";
 
 TStampTblEntry* gStampTbl;
 
+/* true and false sharing transfers of the whole run */
+volatile UINT64 gTrueSharing = 0;
+volatile UINT64 gFalseSharing = 0;
+
 
 /* ===================================================================== */
 /* Routines */
@@ -137,8 +285,10 @@ TStampTblEntry* gStampTbl;
 
 /* ========================================================
  * SFP Algorithm Logic
+ * returns whether the access is an ownership transfer,
+ * a write after an access by another thread
  * ======================================================== */
-void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType type) {
+bool SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType type, pc_stat_t* pc, heap_site_t* site, comm_rows* comm) {
 
   TStampList s;
 
@@ -146,6 +296,12 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
   s = gStampTbl[set_idx].set[addr];
  
   int head = s.head;
+
+  /* the head of the list is the thread of the previous access */
+  bool transfer = ( type == WRITE_ACCESS && head != -1 && head != tid );
+  if ( type == WRITE_ACCESS ) s.writes++;
+  else s.reads++;
+  if ( transfer ) s.transfers++;
   
   /* traverse the datum's access list to profile
    * the intervals
@@ -166,8 +322,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
     TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
-    __sync_add_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_add_and_fetch(&wcount_i[thd_count][idx], distance);
+    wcount[thd_count].add_atomic(idx, 1);
+    wcount_i[thd_count].add_atomic(idx, distance);
 
     /* update the readonly MI profile */
     if ( s.list[iter].latest > s.last_write && type == READ_ACCESS ) {
@@ -180,8 +336,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
        * profile MI_ro[thd_count_ro][idx] and MI_ro_i[thd_count_ro][idx]
        * which is equivalent to decreasing wcount_ro[thd_count_ro][idx]
        */ 
-      __sync_sub_and_fetch(&wcount_ro[thd_count_ro][idx], 1);
-      __sync_sub_and_fetch(&wcount_ro_i[thd_count_ro][idx], distance);
+      wcount_ro[thd_count_ro].sub_atomic(idx, 1);
+      wcount_ro_i[thd_count_ro].sub_atomic(idx, distance);
     }
 
     /* if tid is met, stop the traversal */
@@ -197,8 +353,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
      * profile SI[thd_count][idx] and SI_i[thd_count][idx]
      * which is equivalent to decreasing MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    __sync_sub_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_sub_and_fetch(&wcount_i[thd_count][idx], distance);
+    wcount[thd_count].sub_atomic(idx, 1);
+    wcount_i[thd_count].sub_atomic(idx, distance);
 
     /* update the readonly SI profile */
     if ( s.list[iter].latest > s.last_write && type == READ_ACCESS ) {
@@ -208,8 +364,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
        * which is equivalent to increasing wcount_ro[thd_count_ro][idx]
        */ 
       thd_count_ro++;
-      __sync_add_and_fetch(&wcount_ro[thd_count_ro][idx], 1);
-      __sync_add_and_fetch(&wcount_ro_i[thd_count_ro][idx], distance);
+      wcount_ro[thd_count_ro].add_atomic(idx, 1);
+      wcount_ro_i[thd_count_ro].add_atomic(idx, distance);
     }
 
   } // for loop
@@ -224,11 +380,16 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
      * increment MI_ro[thd_count_ro][idx] and MI_ro_i[thd_count_ro][idx]
      * which is equivalent to decreasing wcount_ro[thd_count_ro][idx]
      */ 
-    __sync_sub_and_fetch(&wcount_ro[thd_count_ro][idx], 1);
-    __sync_sub_and_fetch(&wcount_ro_i[thd_count_ro][idx], pos-s.last_write-1);
+    wcount_ro[thd_count_ro].sub_atomic(idx, 1);
+    wcount_ro_i[thd_count_ro].sub_atomic(idx, pos-s.last_write-1);
 
   } 
 
+  /* tid reads the datum first since another thread wrote it, a line communicated */
+  if ( comm && iter_ro != tid && type == READ_ACCESS && s.last_writer != -1 && s.last_writer != tid ) {
+    comm->add(s.last_writer, pos - s.last_write, pos);
+  }
+
 
   /* if iter is -1, the list is traversed without finding tid,
    * then this access is first access made by tid
@@ -240,8 +401,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
     /*
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    __sync_add_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_add_and_fetch(&wcount_i[thd_count][idx] , pos-1);
+    wcount[thd_count].add_atomic(idx, 1);
+    wcount_i[thd_count].add_atomic(idx, pos-1);
 
     /* increment the corresponding the element in M,
      * because at each level of sharing, M should be different  
@@ -249,6 +410,16 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
     __sync_add_and_fetch(&M[thd_count].con, 1);
   }
 
+  /* the threads that have accessed the datum, for the per instruction and heap attribution */
+  if ( pc || site ) {
+    int sharers = thd_count + 1;
+    if ( iter != -1 ) {
+      for(int j=s.list[iter].next; j!=-1; j=s.list[j].next) sharers++;
+    }
+    if ( pc ) PC_Record(pc, sharers, iter == -1, type == WRITE_ACCESS);
+    if ( site ) HEAP_Record(site, tid, sharers, iter == -1, type == WRITE_ACCESS);
+  }
+
   
   /* before adjusting any metadata for the time stamp list, if current access is write,
    * we need to collect the intervals with left end at last accesses
@@ -270,8 +441,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
        * increment MI_ro[thd][idx] and MI_ro_i[thd][idx]
        * which is equivalent to decreasing wcount_ro[thd][idx]
        */ 
-      __sync_sub_and_fetch(&wcount_ro[thd][idx], 1);
-      __sync_sub_and_fetch(&wcount_ro_i[thd][idx], pos-s.list[j].latest-1);
+      wcount_ro[thd].sub_atomic(idx, 1);
+      wcount_ro_i[thd].sub_atomic(idx, pos-s.list[j].latest-1);
 
       idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(pos-s.last_write-1);
 
@@ -279,12 +450,13 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
        * increment M_ro[thd][idx] and M_ro_i[thd][idx]
        * which is equivalent to increasing wcount_ro[thd][idx]
        */ 
-      __sync_add_and_fetch(&wcount_ro[thd][idx], 1);
-      __sync_add_and_fetch(&wcount_ro_i[thd][idx], pos-s.last_write-1);
+      wcount_ro[thd].add_atomic(idx, 1);
+      wcount_ro_i[thd].add_atomic(idx, pos-s.last_write-1);
 
     }
 
     s.last_write = pos;
+    s.last_writer = tid;
   }
 
   
@@ -304,9 +476,100 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, TAccessType typ
   /* set back addr's time stamp list */
   gStampTbl[set_idx].set[addr] = s;
 
+  return transfer;
 }
 
 
+/* ========================================================
+ * False sharing detection, called with the entry locked
+ * ======================================================== */
+void FalseSharingImpl(ADDRINT set_idx, ADDRINT line, int tid, UINT64 mask, TAccessType type, heap_site_t* site) {
+
+  TSharingRecord& r = gStampTbl[set_idx].fs[line];
+  UINT64 self = (UINT64)1 << tid;
+
+  /* a thread accessing the line again after an invalidation */
+  if ( (r.touched & self) && !(r.valid & self) ) {
+    if ( r.remote[tid] & mask ) {
+      r.true_sharing++;
+      __sync_add_and_fetch(&gTrueSharing, 1);
+    } else {
+      r.false_sharing++;
+      __sync_add_and_fetch(&gFalseSharing, 1);
+      if ( site ) __sync_add_and_fetch(&site->false_sharing, 1);
+    }
+  }
+  r.remote[tid] = 0;
+  r.touched |= self;
+  r.valid |= self;
+
+  /* a write invalidates the copies of the other threads */
+  if ( type == WRITE_ACCESS ) {
+    r.writers |= self;
+    r.valid = self;
+    for(int t=0; t<MAX_THREAD; t++) {
+      if ( t != tid && (r.touched & ((UINT64)1 << t)) ) r.remote[t] |= mask;
+    }
+  }
+}
+
+/* byte mask of the part of [addr, addr+size) in the line, widened to the mask granularity */
+inline UINT64 LineMask(ADDRINT line, ADDRINT addr, UINT32 size) {
+  ADDRINT grain = KnobFalseSharingGrain.Value() > 1 ? KnobFalseSharingGrain.Value() : 1;
+  ADDRINT lo = addr > line ? addr - line : 0;
+  ADDRINT hi = addr + size - line < WORDWIDTH ? addr + size - line : WORDWIDTH;
+  lo -= lo % grain;
+  hi = (hi + grain - 1) / grain * grain;
+  if ( hi > WORDWIDTH ) hi = WORDWIDTH;
+  if ( hi <= lo ) return 0;
+  return (hi - lo == 64) ? ~(UINT64)0 : (((UINT64)1 << (hi - lo)) - 1) << lo;
+}
+
+/* ========================================================
+ * Dirty footprint, the sfp algorithm over the writes only,
+ * with the time stamps of all accesses
+ * ======================================================== */
+void DirtyImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
+
+  TStampList& s = gStampTbl[set_idx].dirty[addr];
+
+  int iter;
+  int thd_count = 0;
+  int prev = -1;
+
+  for(iter = s.head; iter != -1; iter = s.list[iter].next) {
+
+    TStamp distance = pos - s.list[iter].latest - 1;
+    TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
+    wcount_d[thd_count].add_atomic(idx, 1);
+    wcount_d_i[thd_count].add_atomic(idx, distance);
+
+    if (iter == tid) {
+      break;
+    }
+
+    prev = iter;
+    thd_count++;
+    wcount_d[thd_count].sub_atomic(idx, 1);
+    wcount_d_i[thd_count].sub_atomic(idx, distance);
+  }
+
+  /* first write to the datum by tid */
+  if ( iter == -1 ) {
+    TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(pos-1);
+    wcount_d[thd_count].add_atomic(idx, 1);
+    wcount_d_i[thd_count].add_atomic(idx, pos-1);
+    __sync_add_and_fetch(&M_d[thd_count].con, 1);
+  }
+
+  s.list[tid].latest = pos;
+  if ( prev != -1 ) {
+    s.list[prev].next = s.list[tid].next;
+    s.list[tid].next = s.head;
+  }
+  s.head = tid;
+}
+
 /* ==================================================
  * Routine handling atomic trace processing
  * ================================================== */
@@ -317,6 +580,12 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
   local_stat_t* lstat = get_tls(tid);
   if( !lstat->enabled ) return;
 
+  /* the counters of the instruction, if attributed */
+  pc_stat_t* pc = KnobPc.Value() ? lstat->pcs.lookup((ADDRINT)ip) : NULL;
+
+  /* the allocation site of the heap object accessed, if attributed */
+  heap_site_t* site = KnobHeap.Value() ? HEAP_Find(tid, (ADDRINT)addr) : NULL;
+
   /*
    * laddr is the lowest cacheline base touched by interval [addr, addr+size]
    * raddr is the highest cacheline base touched by interval [addr, addr+size]
@@ -343,7 +612,23 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
 
     if( cur_addr < raddr ) 
     {
-      SfpImpl(set_idx, cur_addr, tid, tempN, (TAccessType)type);
+      bool transfer = SfpImpl(set_idx, cur_addr, tid, tempN, (TAccessType)type, pc, site,
+                              KnobComm.Value() ? &lstat->comm : NULL);
+
+      if ( type == WRITE_ACCESS && KnobDirty.Value() ) {
+        DirtyImpl(set_idx, cur_addr, tid, tempN);
+      }
+
+      if ( transfer && KnobPingPong.Value() ) {
+        lstat->hot_lines.add(cur_addr);
+      }
+      if ( transfer && site ) {
+        __sync_fetch_and_add(&site->transfers, 1);
+      }
+
+      if ( KnobFalseSharing.Value() ) {
+        FalseSharingImpl(set_idx, cur_addr, tid, LineMask(cur_addr, (ADDRINT)addr, size), (TAccessType)type, site);
+      }
     }
 
     /* release the locks on the entries associated with cur_addr */
@@ -384,6 +669,9 @@ inline void ThreadStart_hook(THREADID tid, local_stat_t* tdata) {
   if(tid) {
     activate(tid);
   }
+
+  tdata->hot_lines.set_capacity(KnobPingPong.Value() ? KnobPingPongTop.Value() : 0);
+  tdata->comm.set_phase_len(KnobCommPhase.Value());
 }
 
 //
@@ -423,6 +711,11 @@ VOID Instruction(INS ins, VOID *v) {
     // prefixed instructions appear as predicated instructions in Pin
     //
     
+    /* the shadow call stack of the allocation sites */
+    if ( KnobHeap.Value() && KnobHeapFrames.Value() > 1 ) {
+      HEAP_InstrumentCallStack(ins);
+    }
+
     UINT32 memOperands = INS_MemoryOperandCount(ins);
     
     for (UINT32 memOp = 0; memOp < memOperands; memOp++) {
@@ -522,9 +815,151 @@ LOCALFUN VOID CollectLastAccesses() {
 
       }
     }
+
+    /* the intervals between the last write of every thread and the trace end */
+    for(map<ADDRINT, TStampList>::iterator iter = gStampTbl[i].dirty.begin(); iter!=gStampTbl[i].dirty.end(); iter++) {
+
+      TStampList& s = iter->second;
+      for(j=s.head, thd_count = 0; j!=-1; j=s.list[j].next, thd_count++) {
+
+        TStamp distance = N - s.list[j].latest;
+        TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
+        wcount_d[thd_count][idx]++;
+        wcount_d_i[thd_count][idx] += distance;
+      }
+    }
   }
 }
 
+//
+// helper routine in Fini
+// to report the most falsely shared lines
+//
+LOCALFUN bool ByFalseSharing(const pair<ADDRINT, TSharingRecord*>& a, const pair<ADDRINT, TSharingRecord*>& b) {
+  return a.second->false_sharing > b.second->false_sharing;
+}
+
+LOCALFUN VOID WriteFalseSharing() {
+
+  vector< pair<ADDRINT, TSharingRecord*> > lines;
+  for(int i=0;i<MAP_SIZE+1;i++) {
+    for(map<ADDRINT, TSharingRecord>::iterator iter = gStampTbl[i].fs.begin(); iter!=gStampTbl[i].fs.end(); iter++) {
+      if ( iter->second.false_sharing ) lines.push_back(make_pair(iter->first, &iter->second));
+    }
+  }
+
+  size_t top = min((size_t)KnobFalseSharingTop.Value(), lines.size());
+  partial_sort(lines.begin(), lines.begin()+top, lines.end(), ByFalseSharing);
+
+  ofstream out(KnobFalseSharingFile.Value().c_str());
+  out << "transfers: " << gTrueSharing + gFalseSharing << " true: " << gTrueSharing
+      << " false: " << gFalseSharing << " falsely shared lines: " << lines.size() << endl;
+  out << "line\tfalse\ttrue\tthreads\twriters" << endl;
+
+  for(size_t i=0; i<top; i++) {
+    TSharingRecord* r = lines[i].second;
+    out << hex << "0x" << lines[i].first << dec << "\t" << r->false_sharing << "\t" << r->true_sharing << "\t";
+    for(int t=0, first=1; t<MAX_THREAD; t++) {
+      if ( !(r->touched & ((UINT64)1 << t)) ) continue;
+      out << (first ? "" : ",") << t;
+      first = 0;
+    }
+    out << "\t";
+    for(int t=0, first=1; t<MAX_THREAD; t++) {
+      if ( !(r->writers & ((UINT64)1 << t)) ) continue;
+      out << (first ? "" : ",") << t;
+      first = 0;
+    }
+    out << endl;
+  }
+
+  out.close();
+}
+
+//
+// helper routine in Fini
+// to merge the contended lines of all threads and report them
+//
+LOCALFUN VOID WritePingPong() {
+
+  space_saving<ADDRINT> hot(KnobPingPongTop.Value());
+  for(unsigned int i=0;i<gThreadNum;i++) {
+    hot.merge(get_tls(i)->hot_lines);
+  }
+
+  ofstream out(KnobPingPongFile.Value().c_str());
+  out << "line\ttransfers\testimate\terror\treads\twrites\tsharers" << endl;
+
+  for(size_t i=0; i<hot.size(); i++) {
+    ADDRINT line = hot[i].key;
+    TStampList& s = gStampTbl[SetIndex(line)].set[line];
+
+    out << hex << "0x" << line << dec << "\t" << s.transfers << "\t" << hot[i].count << "\t" << hot[i].error
+        << "\t" << s.reads << "\t" << s.writes << "\t";
+
+    /* the threads in the stamp list, most recent first */
+    for(int j=s.head, first=1; j!=-1; j=s.list[j].next) {
+      out << (first ? "" : ",") << j;
+      first = 0;
+    }
+    out << endl;
+  }
+
+  out.close();
+}
+
+//
+// helper routine in Fini
+// to estimate the fill and write-back bandwidth of caches of every size
+//
+// A cache of c lines holds the data of the window whose footprint is c.
+// Each access brings in the growth of the footprint at that window, and
+// writes back the growth of the dirty footprint, the written lines
+// leaving the window at the rate new ones enter it.
+//
+LOCALFUN VOID WriteBandwidth(const vector<TFootprintCurve>& curves, const vector<TFootprintCurve>& dcurves) {
+
+  UINT32 degrees = gThreadNum < MAX_THREAD ? gThreadNum : MAX_THREAD;
+  double cycles = gEndTsc - gStartTsc;
+  double wall = (finish.tv_sec - start.tv_sec) + (finish.tv_usec - start.tv_usec) / 1e6;
+
+  /* the run is timed by the TSC, at the frequency found in main, or by the wall clock without one */
+  double seconds = gTscGhz > 0 ? cycles / (gTscGhz * 1e9) : wall;
+  double rate = KnobBandwidthRate.Value() > 0 ? KnobBandwidthRate.Value() : (seconds > 0 ? N / seconds : 0);
+
+  ofstream out(KnobBandwidthFile.Value().c_str());
+  out << "N:" << N << " cycles:" << (UINT64)cycles
+      << " tsc_ghz:" << gTscGhz << " (" << gTscSource << ")"
+      << " seconds:" << seconds << (gTscGhz > 0 ? " (rdtsc)" : " (wall time)")
+      << " accesses/s:" << rate << (KnobBandwidthRate.Value() > 0 ? " (given)" : " (profiled run)") << endl;
+  out << "# per access ratios in lines, bandwidth in MB/s, wb.k for the data written by at least k threads" << endl;
+  out << "cache\tws\tfill\twb\tfill.MBps\twb.MBps";
+  for(UINT32 k=0; k<degrees; k++) {
+    out << "\twb." << k+1;
+  }
+  out << endl;
+
+  double max_fp = curves[0].max_fp();
+  for(double lines = 1; lines <= 2 * max_fp; lines *= 2) {
+
+    /* the window whose footprint fills the cache */
+    int idx = curves[0].fill_index(lines);
+    double w = idx >= 0 ? curves[0].fill_window(lines) : 0;
+    double fill = curves[0].slope(idx);
+    double wb = idx >= 0 ? dcurves[0].slope_at(w) : 0;
+
+    out << (UINT64)(lines * WORDWIDTH) << "\t" << (UINT64)w
+        << "\t" << setprecision(6) << fill << "\t" << wb
+        << "\t" << fill * rate * WORDWIDTH / 1e6 << "\t" << wb * rate * WORDWIDTH / 1e6;
+    for(UINT32 k=0; k<degrees; k++) {
+      out << "\t" << (idx >= 0 ? dcurves[k].slope_at(w) : 0);
+    }
+    out << endl;
+  }
+
+  out.close();
+}
+
 //
 // routine for openning output file
 //
@@ -550,6 +985,16 @@ LOCALFUN VOID OpenOutputFile() {
 
   }
 
+  if ( KnobDirty.Value() ) {
+    DirtyFile.open((filename + ".dirty").c_str());
+    DirtyFile << dec << "N:" << N << " Memory size: " << MAP_SIZE << " total_time:" << gWalltime  << endl;
+    DirtyFile << "ws\t";
+    for(int j=0;j<MAX_THREAD;j++) {
+      DirtyFile << j+1 << "\t";
+    }
+    DirtyFile << endl;
+  }
+
 }
   
 
@@ -560,15 +1005,21 @@ VOID Fini(INT32 code, VOID* v){
   
   /* get the time when finish */
   gettimeofday(&finish, 0);
+  gEndTsc = SFP_RDTSC();
   gWalltime = (finish.tv_sec - start.tv_sec);
 
   /* the sfp statistics */
-  double sfp[MAX_THREAD], sfp_ro[MAX_THREAD], sfp_wr[MAX_THREAD];
+  double sfp[MAX_THREAD], sfp_ro[MAX_THREAD], sfp_wr[MAX_THREAD], sfp_d[MAX_THREAD];
   
   /* buffer used to hold the sum of wcount and wcount_i arrays */
   double wcount_sum[MAX_THREAD], wcount_sum_i[MAX_THREAD];
   /* buffer used to hold the sum of wcount_ro and wcount_ro_i arrays */
   double wcount_ro_sum[MAX_THREAD], wcount_ro_sum_i[MAX_THREAD];
+  /* buffer used to hold the sum of wcount_d and wcount_d_i arrays */
+  double wcount_d_sum[MAX_THREAD], wcount_d_sum_i[MAX_THREAD];
+
+  /* overall and dirty sfp curves in lines, for the miss ratio and bandwidth prediction */
+  vector<TFootprintCurve> curves(MAX_THREAD), dcurves(MAX_THREAD);
 
   TStamp j, ws;
   int i;
@@ -576,6 +1027,30 @@ VOID Fini(INT32 code, VOID* v){
   /* before analysis, collect the intervals left over at trace end */
   CollectLastAccesses();
 
+  /* the most contended lines, merged from the thread local sketches */
+  if ( KnobPingPong.Value() ) {
+    WritePingPong();
+  }
+
+  /* the lines communicated between threads, merged from the thread local rows */
+  if ( KnobComm.Value() ) {
+    vector<const comm_rows*> rows;
+    for(unsigned int t=0; t<gThreadNum; t++) rows.push_back(&get_tls(t)->comm);
+    COMM_WriteReport(KnobCommFile.Value(), rows);
+  }
+
+  /* the instructions creating the shared footprint */
+  if ( KnobPc.Value() ) {
+    vector<const pc_table*> tables;
+    for(unsigned int t=0; t<gThreadNum; t++) tables.push_back(&get_tls(t)->pcs);
+    PC_WriteReport(KnobPcFile.Value(), tables, KnobPcTop.Value());
+  }
+
+  /* the heap allocation sites creating the shared footprint */
+  if ( KnobHeap.Value() ) {
+    HEAP_WriteReport(KnobHeapFile.Value(), KnobHeapTop.Value(), WORDWIDTH);
+  }
+
   /* clean up the allocated thread local data */
   ThreadEnd();
 
@@ -589,6 +1064,8 @@ VOID Fini(INT32 code, VOID* v){
     wcount_sum_i[i] = 0;
     wcount_ro_sum[i] = 0;
     wcount_ro_sum_i[i] = 0;
+    wcount_d_sum[i] = 0;
+    wcount_d_sum_i[i] = 0;
 
     sfp[i] = 0;
     sfp_ro[i] = 0;
@@ -603,6 +1080,8 @@ VOID Fini(INT32 code, VOID* v){
       wcount_sum_i[i] += wcount_i[i][j];
       wcount_ro_sum[i] += wcount_ro[i][j];
       wcount_ro_sum_i[i] += wcount_ro_i[i][j];
+      wcount_d_sum[i] += wcount_d[i][j];
+      wcount_d_sum_i[i] += wcount_d_i[i][j];
       
     }
   }
@@ -617,6 +1096,7 @@ VOID Fini(INT32 code, VOID* v){
     for(i=0; i<OUTPUT_TYPES; i++) {
       ResultFile[i] << ws;
     }
+    if ( KnobDirty.Value() ) DirtyFile << ws;
 
     for(i=0;i<MAX_THREAD;i++) {
 
@@ -624,27 +1104,59 @@ VOID Fini(INT32 code, VOID* v){
       sfp[i] = M[i].con - sfp[i];
       sfp_ro[i] = 1.0 * (wcount_ro_sum_i[i] - (ws-1)*wcount_ro_sum[i]) / (N-ws+1);
       sfp_wr[i] = sfp[i] - sfp_ro[i];
+      sfp_d[i] = 1.0 * (wcount_d_sum_i[i] - (ws-1)*wcount_d_sum[i]) / (N-ws+1);
+      sfp_d[i] = M_d[i].con - sfp_d[i];
 
       wcount_sum[i] -= wcount[i][j];
       wcount_sum_i[i] -= wcount_i[i][j];
       wcount_ro_sum[i] -= wcount_ro[i][j];
       wcount_ro_sum_i[i] -= wcount_ro_i[i][j];
+      wcount_d_sum[i] -= wcount_d[i][j];
+      wcount_d_sum_i[i] -= wcount_d_i[i][j];
 
       /* one column for each sharing degree */
       ResultFile[ALL_SFP]       << "\t" << setprecision(12) << sfp[i]    * WORDWIDTH;
       ResultFile[READONLY_SFP]  << "\t" << setprecision(12) << sfp_ro[i] * WORDWIDTH;
       ResultFile[READWRITE_SFP] << "\t" << setprecision(12) << sfp_wr[i] * WORDWIDTH;
+
+      curves[i].push_back(ws, sfp[i]);
+
+      if ( KnobDirty.Value() ) {
+        DirtyFile << "\t" << setprecision(12) << sfp_d[i] * WORDWIDTH;
+        dcurves[i].push_back(ws, sfp_d[i]);
+      }
       
     }
 
     for(i=0; i<OUTPUT_TYPES; i++) {
       ResultFile[i] << endl;
     }
+    if ( KnobDirty.Value() ) DirtyFile << endl;
   }
 
   for(i=0; i<OUTPUT_TYPES; i++) {
     ResultFile[i].close();
   }
+  if ( KnobDirty.Value() ) DirtyFile.close();
+
+  /* predict the shared cache miss ratios from the overall sfp */
+  for(i=0;i<MAX_THREAD;i++) {
+    curves[i].accesses = N;
+  }
+  if ( !KnobMrcFile.Value().empty() ) {
+    SFP_WriteMrc(KnobMrcFile.Value(), curves, gThreadNum,
+                 SFP_ParseGroups(KnobMrcGroups.Value(), gThreadNum), WORDWIDTH);
+  }
+
+  /* the most falsely shared lines */
+  if ( KnobFalseSharing.Value() ) {
+    WriteFalseSharing();
+  }
+
+  /* the fill and write-back traffic of caches of every size */
+  if ( KnobDirty.Value() ) {
+    WriteBandwidth(curves, dcurves);
+  }
 
   /* deallocate the global stamp table */
   delete[] gStampTbl;
@@ -681,6 +1193,11 @@ int main(int argc, char *argv[])
     for(TStamp i=0; i<(MAP_SIZE+1); i++)
       lock_release(&gStampTbl[i].lock);
 
+    /* hook the allocators for the heap attribution */
+    if ( KnobHeap.Value() ) {
+      HEAP_Init(KnobHeapFrames.Value());
+    }
+
     /* check for knobs if region instrumentation is involved */
     control.RegisterHandler(ControlHandler, 0, FALSE);
     control.Activate();
@@ -694,8 +1211,20 @@ int main(int argc, char *argv[])
     /* init thread hooks, implemented in thread_support.H */
     ThreadInit();
 
+    /* the TSC frequency, given, reported by CPUID or measured over 50 ms */
+    gTscGhz = KnobTscGhz.Value();
+    if ( gTscGhz <= 0 ) {
+      gTscGhz = SFP_CpuidTscGhz();
+      gTscSource = "cpuid";
+    }
+    if ( gTscGhz <= 0 ) {
+      gTscGhz = SFP_CalibrateTscGhz(50);
+      gTscSource = "calibrated";
+    }
+
     /* start timing now */
     gettimeofday(&start, 0);
+    gStartTsc = SFP_RDTSC();
 
     // Never returns
     PIN_StartProgram();
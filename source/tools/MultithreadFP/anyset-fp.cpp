@@ -2,6 +2,8 @@
 #include <fstream>
 #include <stdlib.h>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <sys/time.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,8 +11,11 @@
 #include "pin.H"
 #include "portability.H"
 #include "histo.H"
-#include "atomic.h"
+#include "atomic.H"
 #include "instlib.H"
+#include "sfp_mrc.H"
+#include "sfp_topology.H"
+#include "sfp_pairs.H"
 
 using namespace std;
 using namespace histo;
@@ -23,7 +28,8 @@ using namespace INSTLIB;
                           // the lowest pillar is expected to be 2^12,
                           // therefore 2^34 / 2^12 = 2^22 = 4^11 pillars are needed
 #define MAP_SIZE 0x7fffff // if long is 64bit, size should be larger 
-#define MAX_THREAD 22     // max thread supported
+#define MAX_THREAD 256    // max thread supported
+#define MAX_SET_THREAD 22 // max thread supported by the thread set tables, 2^MAX_SET_THREAD entries
 
 #define SETSHIFT 6
 #define WORDSHIFT 6
@@ -45,6 +51,22 @@ using namespace INSTLIB;
 KNOB<string> KnobResultFile(KNOB_MODE_WRITEONCE, "pintool",
 			    "o", "fp.out", "specify result file name");
 
+/* knob of the predicted miss ratio curve file */
+KNOB<string> KnobMrcFile(KNOB_MODE_WRITEONCE, "pintool",
+			 "mrc", "", "specify the miss ratio curve file name, no curves if empty");
+
+/* knob of the thread group sizes composed in the miss ratio curves */
+KNOB<string> KnobMrcGroups(KNOB_MODE_WRITEONCE, "pintool",
+			   "mrc_groups", "", "comma separated thread group sizes, powers of two below the thread count by default");
+
+/* knobs of the topology-aware footprint report, see sfp_topology.H */
+KNOB<string> KnobTopology(KNOB_MODE_WRITEONCE, "pintool",
+			  "topo", "", "cache levels as name:cpus_per_cache[:size_kb],..., no report if empty");
+KNOB<string> KnobTopologyFile(KNOB_MODE_WRITEONCE, "pintool",
+			      "topo_o", "topo.out", "specify the topology report file name");
+KNOB<string> KnobPinning(KNOB_MODE_WRITEONCE, "pintool",
+			 "pinning", "", "cpu of each thread, comma separated, instead of sched_getaffinity");
+
 /* A Pillar is a particular window length, for which, our tools accurately 
  * measure any thread set's shared footprint
  */
@@ -56,6 +78,30 @@ KNOB<int> KnobLPillar(KNOB_MODE_WRITEONCE, "pintool",
 KNOB<string> KnobSharingGraphFile(KNOB_MODE_WRITEONCE, "pintool",
 			      "g", "sg.out", "specify the sharing graph file name");
 
+/* knob of the thread set tables, 2^MAX_SET_THREAD entries per pillar */
+KNOB<BOOL> KnobSets(KNOB_MODE_WRITEONCE, "pintool",
+		    "sets", "1", "count the windows of every thread set at the pillars, up to 22 threads, 0 skips the tables and the sharing graph for up to 256 threads");
+
+/* knob of the pairwise shared footprint */
+KNOB<BOOL> KnobPairs(KNOB_MODE_WRITEONCE, "pintool",
+		     "pairs", "0", "compute the shared footprint of every thread pair at the pillars");
+
+/* knob of the pairwise shared footprint file */
+KNOB<string> KnobPairsFile(KNOB_MODE_WRITEONCE, "pintool",
+			   "pairs_o", "pairs.out", "specify the pairwise shared footprint file name");
+
+
+/* knob of per instruction attribution */
+KNOB<BOOL> KnobPc(KNOB_MODE_WRITEONCE, "pintool",
+		  "pc", "0", "attribute the shared accesses and first touches to instructions");
+
+/* knob of the per instruction report file */
+KNOB<string> KnobPcFile(KNOB_MODE_WRITEONCE, "pintool",
+			"pc_o", "pc.out", "specify the per instruction report file name");
+
+/* knob of the number of reported instructions */
+KNOB<UINT32> KnobPcTop(KNOB_MODE_WRITEONCE, "pintool",
+		       "pc_top", "100", "number of instructions with the most shared accesses to report");
 
 /* control variable */
 LOCALVAR CONTROL control;
@@ -69,31 +115,32 @@ typedef union {
   char padding[WORDWIDTH];
 } TPStamp;
 
-/* a compact list of time stamps */
+/* the latest access of a thread to a datum */
 typedef struct {
   TStamp latest;
-  char next;
+  UINT32 tid;
 } TStampListElement;
 
-/* metadata associated with each datum */
-typedef struct TStampList_t {
-
-  /* a compact list of time stamps */
-  TStampListElement list[MAX_THREAD];
-  char head;
+/* metadata associated with each datum, the threads that accessed it
+ * from the most recent on, so its size is the sharers of the datum
+ * and not the thread limit
+ */
+typedef vector<TStampListElement> TStampList;
 
-  TStampList_t() : head(-1) {
-    for(int i=0;i<MAX_THREAD;i++) {
-      list[i].latest = 0;
-      list[i].next = -1;
-    }
-  }
-} TStampList;
+/* access type */
+enum TAccessType {
+  READ_ACCESS = 0,
+  WRITE_ACCESS,
+  TOTAL_ACCESS_TYPES
+};
 
 /* configures used in histo.H */
 const  uint32_t              SUBLOG_BITS = 8;
 const  uint32_t              MAX_WINDOW = (65-SUBLOG_BITS)*(1<<SUBLOG_BITS);
 
+/* histogram of intervals over window lengths */
+typedef histogram<MAX_WINDOW, sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>, sublog_index_to_value<MAX_WINDOW, SUBLOG_BITS>, INT64> TWindowHisto;
+
 /* time stamp table entry, each entry is a set of time stamps */ 
 typedef struct {
   sfp_lock_t lock;
@@ -114,8 +161,8 @@ TStamp gWalltime;
 volatile static TStamp N = 0; // trace length
 TPStamp M[MAX_THREAD];        // total memory footprint for each thread count
 
-INT64 wcount[MAX_THREAD][MAX_WINDOW];
-INT64 wcount_i[MAX_THREAD][MAX_WINDOW];
+TWindowHisto wcount[MAX_THREAD];
+TWindowHisto wcount_i[MAX_THREAD];
 
 /* global stamp table */
 TStampTblEntry* gStampTbl;
@@ -137,27 +184,25 @@ TStamp gPillarLengths[MAX_PILLARS];
 /* ========================================================
  * SFP Algorithm Logic
  * ======================================================== */
-void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
-
-  TStampList s;
+void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, pc_stat_t* pc, bool write) {
 
   /* find current address's stamp */
-  s = gStampTbl[set_idx].set[addr];
- 
-  int head = s.head;
-  
-  /* traverse the datum's access list to profile
-   * the intervals
-   * if current access is first access to the 
-   * datum by this thread, following loop will
-   * be skipped
-   */
-  int iter;
+  TStampList& s = gStampTbl[set_idx].set[addr];
+  int size = s.size();
+
+  /* the position of tid in the list, size if this is its first access */
+  int own = 0;
+  while ( own < size && (int)s[own].tid != tid ) own++;
+
+  /* the own gap of tid, for the pairwise shared footprint */
+  bool first = ( own == size );
+  TStamp solo = pos - (first ? 0 : s[own].latest) - 1;
+
+  int k;
   int thd_count = 0;
-  int prev = -1;
 
   /* following loop profiles the pillar statistics, to obtain any thread set's fp */
-  for(int i=0; i<MAX_PILLARS && pos>gPillarLengths[i]; i++)
+  for(int i=0; i<MAX_PILLARS && pos>gPillarLengths[i] && KnobSets.Value(); i++)
   {
     // FIXME use int to store a bitmap, is it OK?
     int bitmap = 0;
@@ -166,9 +211,9 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
     TStamp high = pos - gPillarLengths[i];
     /* low is the left most point a window's left end could reach */
     TStamp low;
-    if ( head != -1 && s.list[head].latest > gPillarLengths[i] )
+    if ( size && s[0].latest > gPillarLengths[i] )
     {
-      low = s.list[head].latest - gPillarLengths[i];
+      low = s[0].latest - gPillarLengths[i];
     }
     else
     {
@@ -183,17 +228,17 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
      * datum's time stamp list
      */
     TStamp rpoint = high;
-    for(iter=head; iter!=-1; iter=s.list[iter].next)
+    for(k=0; k<size; k++)
     {
      /* by moving rpoint, we can determine the count of windows of
       * different sharer sets
       */
-      TStamp c = s.list[iter].latest;
+      TStamp c = s[k].latest;
 
-      /* c > high means all these windows must contain thread 'iter' */
+      /* c > high means all these windows must contain thread 's[k].tid' */
       if ( c > high )
       {
-        bitmap |= (1<<iter);
+        bitmap |= (1<<s[k].tid);
         continue;
       }
 
@@ -212,75 +257,83 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos) {
 
       /* update rpoint and bitmap */
       rpoint = c;
-      bitmap |= (1<<iter);
+      bitmap |= (1<<s[k].tid);
     }
 
     __sync_fetch_and_add(&gPillars[i][bitmap], rpoint-low);
   }
 
-  for(iter = head; iter != -1; iter = s.list[iter].next) {
+  for(k = 0; k < size; k++) {
 
     /* if we reach the last access by tid */
-    TStamp distance = pos - s.list[iter].latest - 1;
+    TStamp distance = pos - s[k].latest - 1;
 
     /*
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
     TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
-    __sync_add_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_add_and_fetch(&wcount_i[thd_count][idx], distance);
+    wcount[thd_count].add_atomic(idx, 1);
+    wcount_i[thd_count].add_atomic(idx, distance);
 
     /* if tid is met, stop the traversal */
-    if (iter == tid) {
+    if (k == own) {
       break;
     }
 
-    /* always record the previous thread before tid */
-    prev = iter;
+    /* s[k].tid accessed the datum after tid, the gap of the pair's union ends here */
+    if ( KnobPairs.Value() ) {
+      PAIRS_Union(tid, s[k].tid, distance, solo, first);
+    }
+
     thd_count++;
 
     /*
      * profile SI[thd_count][idx] and SI_i[thd_count][idx]
      * which is equivalent to decreasing MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    __sync_sub_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_sub_and_fetch(&wcount_i[thd_count][idx], distance);
+    wcount[thd_count].sub_atomic(idx, 1);
+    wcount_i[thd_count].sub_atomic(idx, distance);
 
   }
 
-  /* if iter is -1, the list is traversed without finding tid,
+  /* if the list is traversed without finding tid,
    * then this access is first access made by tid
    */
-  if ( iter == -1 ) {
+  if ( first ) {
 
     TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(pos-1);
 
     /*
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    __sync_add_and_fetch(&wcount[thd_count][idx], 1);
-    __sync_add_and_fetch(&wcount_i[thd_count][idx] , pos-1);
+    wcount[thd_count].add_atomic(idx, 1);
+    wcount_i[thd_count].add_atomic(idx, pos-1);
 
     /* increment the corresponding the element in M,
      * because at each level of sharing, M should be different  
      */
     __sync_add_and_fetch(&M[thd_count].con, 1);
   }
-   
-  /* update the latest access time of tid to pos */
-  s.list[tid].latest = pos;
-  
-  /* prev is not -1, prev *MUST* points to tid's previous thread */
-  if ( prev != -1 ) {
-    s.list[prev].next = s.list[tid].next;
-    s.list[tid].next = s.head;
-  }
 
-  /* update head of the stamp list */
-  s.head = tid;
+  if ( KnobPairs.Value() ) {
+    PAIRS_Solo(tid, solo, first);
+  }
 
-  /* set back addr's time stamp list */
-  gStampTbl[set_idx].set[addr] = s;
+  /* the threads that have accessed the datum, for the per instruction attribution */
+  if ( pc ) {
+    PC_Record(pc, first ? size + 1 : size, first, write);
+  }
+   
+  /* move tid to the head of the list with its latest access time pos */
+  if ( first ) {
+    TStampListElement e;
+    e.latest = pos;
+    e.tid = tid;
+    s.insert(s.begin(), e);
+  } else {
+    s[own].latest = pos;
+    rotate(s.begin(), s.begin() + own, s.begin() + own + 1);
+  }
 
 }
 
@@ -295,6 +348,9 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
   local_stat_t* lstat = get_tls(tid);
   if( !lstat->enabled ) return;
 
+  /* the counters of the instruction, if attributed */
+  pc_stat_t* pc = KnobPc.Value() ? lstat->pcs.lookup((ADDRINT)ip) : NULL;
+
   /*
    * laddr is the lowest cacheline base touched by interval [addr, addr+size]
    * raddr is the highest cacheline base touched by interval [addr, addr+size]
@@ -321,7 +377,7 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
 
     if( cur_addr < raddr ) 
     {
-      SfpImpl(set_idx, cur_addr, tid, tempN);
+      SfpImpl(set_idx, cur_addr, tid, tempN, pc, type == WRITE_ACCESS);
     }
 
     /* release the locks on the entries associated with cur_addr */
@@ -338,6 +394,8 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type)
 // activate instrumentation and recording
 //
 inline LOCALFUN VOID activate(THREADID tid) {
+    /* the thread sets are bitmaps of MAX_SET_THREAD threads, the lists and degrees hold MAX_THREAD */
+    if ( tid >= (KnobSets.Value() ? MAX_SET_THREAD : MAX_THREAD) ) return;
     local_stat_t* data = get_tls(tid);
     data->enabled = true;
 }
@@ -362,6 +420,14 @@ inline void ThreadStart_hook(THREADID tid, local_stat_t* tdata) {
   if(tid) {
     activate(tid);
   }
+
+  if ( tid == (KnobSets.Value() ? MAX_SET_THREAD : MAX_THREAD) ) {
+    cerr << "anyset-fp: threads from " << tid << " on are not profiled"
+         << (KnobSets.Value() ? ", run with -sets 0 for more" : "") << endl;
+  }
+
+  /* where the thread is pinned, for the topology report */
+  TOPO_RecordAffinity(tid);
 }
 
 //
@@ -411,6 +477,7 @@ VOID Instruction(INS ins, VOID *v) {
              IARG_THREAD_ID,
              IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
              IARG_MEMORYREAD_SIZE,
+             IARG_UINT32, READ_ACCESS,
              IARG_END);
       }
       if (INS_MemoryOperandIsWritten(ins, memOp)) {
@@ -419,6 +486,7 @@ VOID Instruction(INS ins, VOID *v) {
              IARG_THREAD_ID,
              IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
              IARG_MEMORYWRITE_SIZE,
+             IARG_UINT32, WRITE_ACCESS,
              IARG_END);
       }
     }
@@ -463,19 +531,20 @@ LOCALFUN VOID CollectLastAccesses() {
     /* traversing all data in a set */
     for(map<ADDRINT, TStampList>::iterator iter = gStampTbl[i].set.begin(); iter!=gStampTbl[i].set.end(); iter++) {
 
-      TStampList s = iter->second;
-      int head = s.head;
+      const TStampList& s = iter->second;
+      int size = s.size();
+      if ( size == 0 ) continue;
       
       /* the logic of profiling the leftover intervals is the same in SfpImpl */
-      for(int k=0; k<MAX_PILLARS && N+1>gPillarLengths[k]; k++)
+      for(int k=0; k<MAX_PILLARS && N+1>gPillarLengths[k] && KnobSets.Value(); k++)
       {
         int bitmap = 0;
         TStamp high = N+1-gPillarLengths[k];
         TStamp low;
 
-        if ( s.list[head].latest > gPillarLengths[k] )
+        if ( s[0].latest > gPillarLengths[k] )
         {
-          low = s.list[head].latest - gPillarLengths[k];
+          low = s[0].latest - gPillarLengths[k];
         }
         else
         {
@@ -483,26 +552,26 @@ LOCALFUN VOID CollectLastAccesses() {
         }
 
         TStamp rpoint = high;
-        for(j=s.head; j!=-1; j=s.list[j].next)
+        for(j=0; j<size; j++)
         {
-          TStamp c = s.list[j].latest;
+          TStamp c = s[j].latest;
           if ( c <= low )  break;
           if ( c > high )
           {
-            bitmap |= (1<<j);
+            bitmap |= (1<<s[j].tid);
             continue;
           }
           gPillars[k][bitmap] += rpoint-c;
           rpoint = c;
-          bitmap |= (1<<j);
+          bitmap |= (1<<s[j].tid);
         }
         gPillars[k][bitmap] += rpoint - low;
       }
  
       /* traverse address's stamp's list to collect leftover intervals */
-      for(j=s.head, thd_count = 0; j!=-1; j=s.list[j].next, thd_count++) {
+      for(j=0, thd_count = 0; j<size; j++, thd_count++) {
 
-        TStamp distance = N - s.list[j].latest;
+        TStamp distance = N - s[j].latest;
         TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
 
         /*
@@ -512,10 +581,27 @@ LOCALFUN VOID CollectLastAccesses() {
         wcount_i[thd_count][idx] += distance;
 
       }
+
+      /* the last accesses end the gaps of the pairs, except behind a more recent thread */
+      if ( KnobPairs.Value() ) {
+        vector<int> ahead;
+        for(j=0; j<size; j++) {
+          PAIRS_Tail(s[j].tid, N - s[j].latest, ahead);
+          ahead.push_back(s[j].tid);
+        }
+      }
     }
   }
 }
 
+//
+// sharing degree columns of the result file, as many as the set tables
+// hold or as the threads of the run beyond that
+//
+LOCALFUN int Degrees() {
+  return gThreadNum > MAX_SET_THREAD ? (gThreadNum < MAX_THREAD ? gThreadNum : MAX_THREAD) : MAX_SET_THREAD;
+}
+
 //
 // routine for openning output file
 //
@@ -524,7 +610,7 @@ LOCALFUN VOID OpenOutputFile() {
   ResultFile.open(KnobResultFile.Value().c_str());
   ResultFile << dec << "N:" << N << " Memory size: " << MAP_SIZE << " total_time:" << gWalltime  << endl;  
   ResultFile << "ws\t";
-  for(TStamp j=0;j<MAX_THREAD;j++) {
+  for(int j=0;j<Degrees();j++) {
     ResultFile << j+1 << "\t";
   }
   ResultFile << endl;
@@ -537,7 +623,7 @@ LOCALFUN VOID OpenOutputFile() {
 LOCALFUN VOID BuildSharingGraph()
 {
   // FIXME is it ok here to use int to represent a bitmap
-  int max_index = 1<<gThreadNum;
+  int max_index = 1<<(gThreadNum < MAX_SET_THREAD ? gThreadNum : MAX_SET_THREAD);
 
   /* dump gPillars profile to file */
   ofstream sharing_graph_file;
@@ -557,7 +643,7 @@ LOCALFUN VOID BuildSharingGraph()
     /* dump to files */
     for( int i=1; i<max_index; i++)
     {
-      char buffer[MAX_THREAD+1];
+      char buffer[MAX_SET_THREAD+1];
       int n = i;
       int k = 0;
       do {
@@ -577,6 +663,25 @@ LOCALFUN VOID BuildSharingGraph()
   }
 }
 
+//
+// footprint in bytes of the data accessed by any thread of set
+// in windows of pillar length ws, for the topology report
+//
+LOCALFUN double PillarFootprint(UINT64 set, double ws)
+{
+  int j = 0;
+  while ( j < MAX_PILLARS-1 && gPillarLengths[j] < ws ) j++;
+
+  /* clamp before the shift, the run may have more threads than the sets */
+  UINT32 threads = gThreadNum < MAX_SET_THREAD ? gThreadNum : MAX_SET_THREAD;
+
+  double fp = 0;
+  for( UINT64 i=1; i<((UINT64)1<<threads); i++)
+  {
+    if ( i & set ) fp += gPillars[j][i];
+  }
+  return fp / (N - gPillarLengths[j] + 1) * WORDWIDTH;
+}
 
 //
 // Fini routine, called at application exit
@@ -593,6 +698,9 @@ VOID Fini(INT32 code, VOID* v){
   /* buffer used to hold the sum of wcount and wcount_i arrays */
   double wcount_sum[MAX_THREAD], wcount_sum_i[MAX_THREAD];
 
+  /* sfp curves in lines, for the miss ratio prediction */
+  vector<TFootprintCurve> curves(MAX_THREAD);
+
   TStamp j, ws;
   int i;
   
@@ -600,7 +708,19 @@ VOID Fini(INT32 code, VOID* v){
   CollectLastAccesses();
 
   /* dump the sharing graph from gPillars profile */
-  BuildSharingGraph();
+  if ( KnobSets.Value() ) BuildSharingGraph();
+
+  /* the shared footprint of every thread pair at the pillars */
+  if ( KnobPairs.Value() ) {
+    PAIRS_WriteReport(KnobPairsFile.Value(), N, gThreadNum, WORDWIDTH);
+  }
+
+  /* the instructions creating the shared footprint */
+  if ( KnobPc.Value() ) {
+    vector<const pc_table*> tables;
+    for(unsigned int t=0; t<gThreadNum; t++) tables.push_back(&get_tls(t)->pcs);
+    PC_WriteReport(KnobPcFile.Value(), tables, KnobPcTop.Value());
+  }
 
   /* clean up the allocated thread local data */
   ThreadEnd();
@@ -644,8 +764,9 @@ VOID Fini(INT32 code, VOID* v){
       wcount_sum_i[i] -= wcount_i[i][j];
 
       /* one column for each sharing degree */
-      ResultFile << "\t" << setprecision(12) << sfp[i]*WORDWIDTH;
-      
+      if ( i < Degrees() ) ResultFile << "\t" << setprecision(12) << sfp[i]*WORDWIDTH;
+
+      curves[i].push_back(ws, sfp[i]);
     }
 
     ResultFile << endl;
@@ -653,6 +774,25 @@ VOID Fini(INT32 code, VOID* v){
 
   ResultFile.close();  
 
+  /* predict the shared cache miss ratios from the sfp curves */
+  for(i=0;i<MAX_THREAD;i++) {
+    curves[i].accesses = N;
+  }
+  if ( !KnobMrcFile.Value().empty() ) {
+    SFP_WriteMrc(KnobMrcFile.Value(), curves, gThreadNum,
+                 SFP_ParseGroups(KnobMrcGroups.Value(), gThreadNum), WORDWIDTH);
+  }
+
+  /* the footprint each cache of the topology sees under the pinning of the run */
+  if ( !KnobTopology.Value().empty() && KnobSets.Value() ) {
+    vector<double> windows;
+    for(int k=0; k<MAX_PILLARS && gPillarLengths[k] <= N; k++) {
+      windows.push_back(gPillarLengths[k]);
+    }
+    if ( !KnobPinning.Value().empty() ) TOPO_SetPinning(KnobPinning.Value());
+    TOPO_WriteReport(KnobTopologyFile.Value(), KnobTopology.Value(), gThreadNum, windows, PillarFootprint);
+  }
+
   /* deallocate the global stamp table */
   delete[] gStampTbl;
   for(int i=0; i<MAX_PILLARS; i++)
@@ -700,12 +840,20 @@ int main(int argc, char *argv[])
       {
         gPillarLengths[i] = gPillarLengths[i-1]*4;
       }
-      gPillars[i] = new TStamp[1<<MAX_THREAD];
-      for(int j=0; j<(1<<MAX_THREAD); j++)
+      gPillars[i] = NULL;
+      if ( !KnobSets.Value() ) continue;
+
+      gPillars[i] = new TStamp[1<<MAX_SET_THREAD];
+      for(int j=0; j<(1<<MAX_SET_THREAD); j++)
       {
         gPillars[i][j] = 0;
       }
     }
+
+    /* the pairwise shared footprint at the same pillars */
+    if ( KnobPairs.Value() ) {
+      PAIRS_Init(gPillarLengths, MAX_PILLARS);
+    }
       
     /* check for knobs if region instrumentation is involved */
     control.RegisterHandler(ControlHandler, 0, FALSE);
@@ -13,7 +13,7 @@
 #include "rdtsc.H"
 #include "atomic.H"
 #include "instlib.H"
-#include "sfp_list.H"
+#include "sfp_runtime.H"
 
 using namespace std;
 using namespace histo;
@@ -40,6 +40,10 @@ using namespace INSTLIB;
 #define SetIndex(x) (((x)>>SETSHIFT)&MAP_SIZE)
 #define WordIndex(x) ((x)&~WORDMASK)
 
+/* the stamp list is indexed by task id */
+#define MAX_LIST_ENTRIES MAX_THREAD
+#include "sfp_list.H"
+
 #define SFP_SAMPLE_FREQUENCY 20
 #define SFP_LIST_TRIM_FREQUENCY 100000
 
@@ -62,6 +66,22 @@ KNOB<int> KnobLPillar(KNOB_MODE_WRITEONCE, "pintool",
 KNOB<string> KnobSharingGraphFile(KNOB_MODE_WRITEONCE, "pintool",
 			      "g", "sg.out", "specify the sharing graph file name");
 
+/* knob of per instruction attribution */
+KNOB<BOOL> KnobPc(KNOB_MODE_WRITEONCE, "pintool",
+		  "pc", "0", "attribute the shared accesses and first touches to instructions");
+
+/* knob of the per instruction report file */
+KNOB<string> KnobPcFile(KNOB_MODE_WRITEONCE, "pintool",
+			"pc_o", "pc.out", "specify the per instruction report file name");
+
+/* knob of the number of reported instructions */
+KNOB<UINT32> KnobPcTop(KNOB_MODE_WRITEONCE, "pintool",
+		       "pc_top", "100", "number of instructions with the most shared accesses to report");
+
+/* knob of task parallel runtimes to detect task boundaries in */
+KNOB<string> KnobRuntime(KNOB_MODE_WRITEONCE, "pintool",
+			 "r", "auto", "specify runtimes to hook: auto, none, or a list of gomp, tbb, cilk");
+
 
 /* control variable */
 LOCALVAR CONTROL control;
@@ -80,13 +100,13 @@ typedef union {
 /* metadata associated with each datum */
 typedef TList<TStamp> TStampList;
 
-/* simple bitmap type */
-typedef uint64_t TBitset;
-
 /* configures used in histo.H */
 const  uint32_t              SUBLOG_BITS = 8;
 const  uint32_t              MAX_WINDOW = (65-SUBLOG_BITS)*(1<<SUBLOG_BITS);
 
+/* histogram of intervals over window lengths */
+typedef histogram<MAX_WINDOW, sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>, sublog_index_to_value<MAX_WINDOW, SUBLOG_BITS>, INT64> TWindowHisto;
+
 /* time stamp table entry, each entry is a set of time stamps */ 
 typedef struct {
   sfp_lock_t lock;
@@ -118,8 +138,8 @@ volatile static TStamp N = 0; // trace length
 volatile static TStamp N_sample = 0; // trace length
 TPStamp M[MAX_THREAD];        // total memory footprint for each thread count
 
-INT64 wcount[MAX_THREAD][MAX_WINDOW];
-INT64 wcount_i[MAX_THREAD][MAX_WINDOW];
+TWindowHisto wcount[MAX_THREAD];
+TWindowHisto wcount_i[MAX_THREAD];
 
 /* global stamp table */
 TStampTblEntry* gStampTbl;
@@ -135,6 +155,9 @@ map<TBitset, TStamp> gPillars[MAX_PILLARS];
 /* window lengths the pillars represent */
 TStamp gPillarLengths[MAX_PILLARS];
 
+/* the application marks its tasks with SFP_TaskStart and SFP_TaskEnd */
+bool gUserMarkers = false;
+
 
 /* ===================================================================== */
 /* Routines */
@@ -144,7 +167,7 @@ TStamp gPillarLengths[MAX_PILLARS];
 /* ========================================================
  * SFP Algorithm Logic
  * ======================================================== */
-void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, local_stat_t* lstat) {
+void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, local_stat_t* lstat, pc_stat_t* pc, bool write) {
 
   TStampList s;
 
@@ -237,8 +260,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, local_stat_t* l
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
     TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(distance);
-    lstat->wcount[thd_count][idx]++;
-    lstat->wcount_i[thd_count][idx] += distance;
+    lstat->wcount[thd_count].add(idx, 1);
+    lstat->wcount_i[thd_count].add(idx, distance);
 
     /* if tid is met, stop the traversal */
     if (curr == tid) {
@@ -253,14 +276,15 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, local_stat_t* l
      * profile SI[thd_count][idx] and SI_i[thd_count][idx]
      * which is equivalent to decreasing MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
-    lstat->wcount[thd_count][idx]--;
-    lstat->wcount_i[thd_count][idx] -= distance;
+    lstat->wcount[thd_count].add(idx, -1);
+    lstat->wcount_i[thd_count].add(idx, -(INT64)distance);
   }
 
   /* if iter is -1, the list is traversed without finding tid,
    * then this access is first access made by tid
    */
-  if ( !s.is_end(curr) ) {
+  bool first = s.is_end(curr);
+  if ( !first ) {
 
     if ( !s.is_end(prev) )
     {
@@ -273,8 +297,8 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, local_stat_t* l
      * profile MI[thd_count][idx] and MI_i[thd_count][idx]
      */ 
     TStamp idx = sublog_value_to_index<MAX_WINDOW, SUBLOG_BITS>(pos-1);
-    lstat->wcount[thd_count][idx]++;
-    lstat->wcount_i[thd_count][idx] += pos-1;
+    lstat->wcount[thd_count].add(idx, 1);
+    lstat->wcount_i[thd_count].add(idx, pos-1);
 
     /* increment the corresponding the element in M,
      * because at each level of sharing, M should be different  
@@ -285,6 +309,13 @@ void SfpImpl(ADDRINT set_idx, ADDRINT addr, int tid, TStamp pos, local_stat_t* l
 
   s.set_at(tid, pos);
   s.set_front(tid);
+
+  /* the tasks that have accessed the datum, for the per instruction attribution */
+  if ( pc ) {
+    int sharers = 0;
+    for(curr = s.begin(); !s.is_end(curr); curr = s.next(curr)) sharers++;
+    PC_Record(pc, sharers, first, write);
+  }
   
   /* set back addr's time stamp list */
   gStampTbl[set_idx].set[addr] = s;
@@ -311,6 +342,9 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type, A
 
   TStamp start = SFP_RDTSC();
 
+  /* the counters of the instruction, if attributed */
+  pc_stat_t* pc = KnobPc.Value() ? lstat->pcs.lookup((ADDRINT)ip) : NULL;
+
   lstat->length++;
   /*
    * laddr is the lowest cacheline base touched by interval [addr, addr+size]
@@ -329,7 +363,7 @@ VOID RecordMem(THREADID tid, VOID * ip, VOID * addr, UINT32 size, UINT32 type, A
    */
   TStamp tempN = SFP_RDTSC() - gStartTime;
   
-  SfpImpl(set_idx, laddr, lstat->current_task, tempN, lstat );
+  SfpImpl(set_idx, laddr, lstat->current_task, tempN, lstat, pc, type == MEMOP_WRITE);
 
   /* release the locks on the entries associated with cur_addr */
   lock_release(&gStampTbl[set_idx].lock);
@@ -383,16 +417,10 @@ inline void ThreadFini_hook(THREADID tid, local_stat_t* lstat) {
   for(int i=0; i<MAX_THREAD; i++)
   {
     lock_acquire(&gWcountLock[i].lock);
-    //INT64* x = (INT64*)__builtin_assume_aligned(lstat->wcount[i], 64);
-    //INT64* y = (INT64*)__builtin_assume_aligned(wcount[i], 64);
-    //INT64* xi = (INT64*)__builtin_assume_aligned(lstat->wcount_i[i], 64);
-    //INT64* yi = (INT64*)__builtin_assume_aligned(wcount_i[i], 64);
 
-    for(TStamp j=0; j<MAX_WINDOW; j++)
-    {
-      wcount[i][j] += lstat->wcount[i][j];
-      wcount_i[i][j] += lstat->wcount_i[i][j];
-    }
+    /* the per-thread histograms are merged once, at thread end */
+    wcount[i].merge(lstat->wcount[i]);
+    wcount_i[i].merge(lstat->wcount_i[i]);
     //__sync_fetch_and_add(&M[i].con, lstat->M[i]);
     M[i].con += lstat->M[i];
     lock_release(&gWcountLock[i].lock);
@@ -463,6 +491,7 @@ VOID Instruction(INS ins, VOID *v) {
              IARG_THREAD_ID,
              IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
              IARG_MEMORYREAD_SIZE,
+             IARG_UINT32, MEMOP_READ,
              IARG_REG_VALUE, REG_STACK_PTR,
              IARG_END);
       }
@@ -472,6 +501,7 @@ VOID Instruction(INS ins, VOID *v) {
              IARG_THREAD_ID,
              IARG_INST_PTR, IARG_MEMORYOP_EA, memOp,
              IARG_MEMORYWRITE_SIZE,
+             IARG_UINT32, MEMOP_WRITE,
              IARG_REG_VALUE, REG_STACK_PTR,
              IARG_END);
       }
@@ -654,6 +684,13 @@ VOID Fini(INT32 code, VOID* v){
   /* dump the sharing graph from gPillars profile */
   BuildSharingGraph();
 
+  /* the instructions creating the shared footprint */
+  if ( KnobPc.Value() ) {
+    vector<const pc_table*> tables;
+    for(unsigned int t=0; t<gThreadNum; t++) tables.push_back(&get_tls(t)->pcs);
+    PC_WriteReport(KnobPcFile.Value(), tables, KnobPcTop.Value());
+  }
+
   /* clean up the allocated thread local data */
   ThreadEnd();
 
@@ -743,6 +780,40 @@ void BeforeTaskEnd(int tid) {
 
 }
 
+//
+// Task start detected by the runtime adapters in sfp_runtime.H
+//
+// The runtime task ids grow without bound, they are folded onto the
+// stamp list entries after entry 0, the code outside of any task
+//
+VOID RuntimeTaskStart(THREADID tid, unsigned int taskid, unsigned int parent)
+{
+  /* user markers take precedence over runtime detection */
+  if ( gUserMarkers ) return;
+
+  if ( taskid == MAX_THREAD ) {
+    cerr << "anytaskset-fp: more than " << MAX_THREAD-1 << " runtime tasks, task ids are folded" << endl;
+  }
+
+  local_stat_t* lstat = get_tls(tid);
+  int slot = (taskid - 1) % (MAX_THREAD - 1) + 1;
+  lstat->tasks.push_back(slot);
+  lstat->current_task = slot;
+}
+
+//
+// Task end detected by the runtime adapters in sfp_runtime.H
+//
+VOID RuntimeTaskEnd(THREADID tid, unsigned int taskid)
+{
+  if ( gUserMarkers ) return;
+
+  local_stat_t* lstat = get_tls(tid);
+  if ( lstat->tasks.size() < 2 ) return;
+  lstat->tasks.pop_back();
+  lstat->current_task = lstat->tasks.back();
+}
+
 //
 // Replacing SFP_TaskStart and SFP_TaskEnd to
 // get the user provided task id
@@ -762,6 +833,7 @@ VOID ImageLoad( IMG img, VOID* v) {
 
       RTN_Replace(start_rtn, AFUNPTR(BeforeTaskStart));
       RTN_Replace(end_rtn,   AFUNPTR(BeforeTaskEnd));
+      gUserMarkers = true;
     }
 
   }
@@ -797,14 +869,6 @@ int main(int argc, char *argv[])
     for(TStamp i=0; i<(MAP_SIZE+1); i++)
       lock_release(&gStampTbl[i].lock);
 
-    for(int i=0; i<MAX_THREAD; i++)
-    {
-      for(TStamp j=0; j<MAX_WINDOW; j++)
-      {
-        wcount[i][j] = wcount_i[i][j] = 0;
-      }
-    }
- 
     /* allocate space for gPillars and setup pillar lengths */
     gLowestPillar = KnobLPillar.Value();
     //gPillarLengths[0] = 1 << gLowestPillar;
@@ -826,6 +890,9 @@ int main(int argc, char *argv[])
     PIN_AddFiniFunction(Fini, 0);
     IMG_AddInstrumentFunction(ImageLoad, 0);
 
+    /* hook task parallel runtimes for programs without markers */
+    RT_Activate(RT_ParseKinds(KnobRuntime.Value()), RuntimeTaskStart, RuntimeTaskEnd);
+
     /* init thread hooks, implemented in thread_support.H */
     ThreadInit();
 
@@ -0,0 +1,234 @@
+/* sfp-corun : offline co-run contention predictor
+ *
+ * It reads the binary profiles (fp.bin) of programs profiled alone by
+ * anyk-sfp, and predicts the shared cache miss ratio of every program
+ * when it runs together with each other program, by composable
+ * footprint theory. Program pairs are ranked by predicted interference,
+ * so the least interfering co-locations come first.
+ *
+ * Two programs A and B running together fill a cache of c lines in
+ * the time t where their footprints add up to the cache,
+ *
+ *   fp_A(r_A t) + fp_B(r_B t) = c
+ *
+ * with r the access rate of each program, and the miss ratio of A is
+ * the growth of its own footprint at r_A t. Alone, the miss ratio of A
+ * is the growth of fp_A where fp_A fills the whole cache (sfp_mrc.H).
+ * The interference of a pair is the sum of the extra misses per
+ * second, or per access with -u, of both programs.
+ *
+ * The access rate of a program is its accesses divided by the wall
+ * time of its profiled run. Instrumentation slows programs down by
+ * different factors, so -u assumes equal rates instead.
+ *
+ * The pairs are evaluated in parallel by -j threads.
+ *
+ * example run:
+ *
+ * sfp-corun -c 8192 -j 8 a.bin b.bin c.bin d.bin > corun.out
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sfp_profile.H"
+#include "sfp_mrc.H"
+
+using namespace std;
+
+/* ===================================================================== */
+/* Profiles */
+/* ===================================================================== */
+
+struct TProgram {
+  string name;
+  TFootprintCurve fp;   /* footprint of all threads, in lines */
+  double rate;          /* accesses per second */
+  double solo_mr;       /* miss ratio when running alone */
+};
+
+vector<TProgram> gPrograms;
+
+static bool ReadProfile(const string& filename, bool uniform, TProgram& p)
+{
+  TProfileReader reader;
+  if ( !reader.open(filename) ) {
+    cerr << "cannot read profile " << filename << endl;
+    return false;
+  }
+
+  p.name = filename;
+  p.rate = 1;
+
+  double walltime = 0;
+  TProfileSection s;
+  while ( reader.next_section(s) ) {
+    if ( s.type == SECTION_SFP_CURVES && s.id == 0 && s.cols >= 2 ) {
+      vector<double> data;
+      reader.read_payload(s, data);
+      for(uint64_t r=0; r<s.rows; r++) {
+        p.fp.push_back(data[r*s.cols], data[r*s.cols+1]);
+      }
+    } else if ( s.type == SECTION_RUN_INFO && s.cols >= RUN_INFO_COLS ) {
+      vector<int64_t> info;
+      reader.read_payload(s, info);
+      p.fp.accesses = info[RUN_INFO_ACCESSES];
+      walltime = info[RUN_INFO_WALLTIME_US] / 1e6;
+    } else {
+      reader.skip_payload(s);
+    }
+  }
+  reader.close();
+
+  if ( p.fp.size() == 0 ) {
+    cerr << filename << " has no sfp curves" << endl;
+    return false;
+  }
+  if ( !uniform && walltime > 0 ) p.rate = p.fp.accesses / walltime;
+  return true;
+}
+
+/* ===================================================================== */
+/* Co-run model */
+/* ===================================================================== */
+
+struct TPairResult {
+  int a, b;
+  double mr_a, mr_b;    /* co-run miss ratios */
+  double interference;
+};
+
+/* predict the co-run miss ratios of a pair sharing a cache of the given lines */
+static TPairResult CoRun(int a, int b, double lines)
+{
+  const TProgram& A = gPrograms[a];
+  const TProgram& B = gPrograms[b];
+
+  TPairResult r;
+  r.a = a;
+  r.b = b;
+  r.mr_a = r.mr_b = 0;
+
+  /* bisect the fill time between 0 and the end of the longer program */
+  double hi = max(A.fp.ws.back() / A.rate, B.fp.ws.back() / B.rate);
+  if ( A.fp.at(A.rate * hi) + B.fp.at(B.rate * hi) >= lines ) {
+    double lo = 0;
+    for(int i=0; i<64; i++) {
+      double t = (lo + hi) / 2;
+      if ( A.fp.at(A.rate * t) + B.fp.at(B.rate * t) < lines ) lo = t;
+      else hi = t;
+    }
+    r.mr_a = A.fp.slope_at(A.rate * hi);
+    r.mr_b = B.fp.slope_at(B.rate * hi);
+  }
+
+  r.interference = (r.mr_a - A.solo_mr) * A.rate + (r.mr_b - B.solo_mr) * B.rate;
+  return r;
+}
+
+/* pairs shared by the workers, the next pair to evaluate is taken atomically */
+struct TWork {
+  vector< pair<int,int> > pairs;
+  vector<TPairResult> results;
+  double lines;
+  volatile long next;
+};
+
+static void* Worker(void* arg)
+{
+  TWork* w = (TWork*)arg;
+  long n = w->pairs.size();
+  long i;
+  while ( (i = __sync_fetch_and_add(&w->next, 1)) < n ) {
+    w->results[i] = CoRun(w->pairs[i].first, w->pairs[i].second, w->lines);
+  }
+  return NULL;
+}
+
+static bool ByInterference(const TPairResult& x, const TPairResult& y)
+{
+  return x.interference < y.interference;
+}
+
+/* ===================================================================== */
+/* main */
+/* ===================================================================== */
+
+static int Usage(const char* prog)
+{
+  cerr << "usage: " << prog << " -c cache_kb [-b line_size] [-j threads] [-u] profile.bin ..." << endl;
+  return -1;
+}
+
+int main(int argc, char* argv[])
+{
+  double cache_kb = 0;
+  int linesize = 64;
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  bool uniform = false;
+  int c;
+
+  while ( (c = getopt(argc, argv, "c:b:j:u")) != -1 ) {
+    switch (c) {
+      case 'c': cache_kb = atof(optarg); break;
+      case 'b': linesize = atoi(optarg); break;
+      case 'j': jobs = atoi(optarg); break;
+      case 'u': uniform = true; break;
+      default: return Usage(argv[0]);
+    }
+  }
+  if ( cache_kb <= 0 || linesize < 1 || argc - optind < 2 ) return Usage(argv[0]);
+  if ( jobs < 1 ) jobs = 1;
+
+  double lines = cache_kb * 1024 / linesize;
+
+  for(int i=optind; i<argc; i++) {
+    TProgram p;
+    if ( !ReadProfile(argv[i], uniform, p) ) return -1;
+    p.solo_mr = p.fp.miss_ratio(lines);
+    gPrograms.push_back(p);
+  }
+
+  TWork work;
+  work.lines = lines;
+  work.next = 0;
+  for(size_t a=0; a<gPrograms.size(); a++) {
+    for(size_t b=a+1; b<gPrograms.size(); b++) {
+      work.pairs.push_back(make_pair((int)a, (int)b));
+    }
+  }
+  work.results.resize(work.pairs.size());
+
+  vector<pthread_t> workers(jobs);
+  for(int i=0; i<jobs; i++) pthread_create(&workers[i], NULL, Worker, &work);
+  for(int i=0; i<jobs; i++) pthread_join(workers[i], NULL);
+
+  sort(work.results.begin(), work.results.end(), ByInterference);
+
+  cout << "# cache " << (uint64_t)(lines * linesize) << " bytes, interference in extra misses per "
+       << (uniform ? "access" : "second") << endl;
+  cout << "program\tsolo.mr\trate" << endl;
+  for(size_t i=0; i<gPrograms.size(); i++) {
+    cout << gPrograms[i].name << "\t" << setprecision(6) << gPrograms[i].solo_mr
+         << "\t" << gPrograms[i].rate << endl;
+  }
+  cout << endl;
+
+  cout << "a\tb\ta.mr\tb.mr\tinterference" << endl;
+  for(size_t i=0; i<work.results.size(); i++) {
+    const TPairResult& r = work.results[i];
+    cout << gPrograms[r.a].name << "\t" << gPrograms[r.b].name
+         << "\t" << setprecision(6) << r.mr_a << "\t" << r.mr_b
+         << "\t" << r.interference << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,234 @@
+/* sfp-hll : offline footprint of thread groups from the HLL sketches
+ *
+ * It reads the binary profile (fp.bin) of an anyk-sfp -hll run, with a
+ * HyperLogLog sketch of the lines of every thread in every time bucket
+ * (sfp_hll.H), and estimates the footprint of any group of threads in
+ * windows of any length, not only the pillars of the tools.
+ *
+ * The sketches of the group are merged per bucket first. A window of w
+ * accesses is covered by k = w / width whole buckets, at least one, and
+ * the footprint of the group in it is the estimate of the merged sketch
+ * of k neighbouring buckets, averaged over evenly spaced start buckets.
+ * So the window lengths are multiples of the bucket width, and the
+ * relative error of an estimate is about 1.04 / sqrt(2^p).
+ *
+ * The footprint of the data a group shares, or of the data shared by
+ * some of its threads, follows by inclusion-exclusion over the groups,
+ * e.g. sfp(a,b) = fp(a) + fp(b) - fp(a,b).
+ *
+ * example run:
+ *
+ * sfp-hll -f fp.bin -g "0;1;0,1;0,1,2,3" -s 64
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sfp_profile.H"
+#include "sfp_hll.H"
+
+using namespace std;
+
+/* the sketches of thread t in bucket b, gSketch[t][b] */
+vector<vector<hll_sketch> > gSketch;
+
+/* the sketch parameters and the run length */
+int gPrecision = 0;
+uint64_t gWidth = 0;
+uint64_t gBuckets = 0;
+double gAccesses = 0;
+
+/* ===================================================================== */
+/* Profile */
+/* ===================================================================== */
+
+static bool ReadProfile(const string& filename)
+{
+  TProfileReader reader;
+  if ( !reader.open(filename) ) {
+    cerr << "cannot read profile " << filename << endl;
+    return false;
+  }
+  gAccesses = reader.get_header().length;
+
+  TProfileSection s;
+  while ( reader.next_section(s) ) {
+    if ( s.type == SECTION_HLL_INFO && s.cols >= HLL_INFO_COLS && s.rows == 1 ) {
+      vector<int64_t> info;
+      reader.read_payload(s, info);
+      gPrecision = info[HLL_INFO_PRECISION];
+      gWidth = info[HLL_INFO_WIDTH];
+      gBuckets = info[HLL_INFO_BUCKETS];
+      continue;
+    }
+
+    /* the info section comes first, the register rows are [bucket, packed registers] */
+    if ( s.type != SECTION_HLL_REGISTERS || gPrecision == 0 || s.cols != 1 + ((uint64_t)1 << gPrecision) / 8 ) {
+      reader.skip_payload(s);
+      continue;
+    }
+
+    vector<int64_t> data;
+    reader.read_payload(s, data);
+
+    if ( s.id >= gSketch.size() ) gSketch.resize(s.id + 1);
+    vector<hll_sketch>& series = gSketch[s.id];
+    series.resize(gBuckets);
+    for(uint64_t r=0; r<s.rows; r++) {
+      const int64_t* row = &data[r*s.cols];
+      if ( row[0] < 0 || (uint64_t)row[0] >= gBuckets ) continue;
+      series[row[0]].unpack(row + 1, gPrecision);
+    }
+  }
+  reader.close();
+
+  if ( gPrecision == 0 || gSketch.empty() ) {
+    cerr << filename << " has no hll sketches, run anyk-sfp with -hll" << endl;
+    return false;
+  }
+  for(size_t t=0; t<gSketch.size(); t++) gSketch[t].resize(gBuckets);
+  return true;
+}
+
+/* ===================================================================== */
+/* Estimation */
+/* ===================================================================== */
+
+/* parse "0,1;2,3" into groups of thread ids, the empty string is all threads */
+static bool ParseGroups(const string& spec, vector<vector<int> >& groups)
+{
+  if ( spec.empty() ) {
+    groups.push_back(vector<int>());
+    for(size_t t=0; t<gSketch.size(); t++) groups.back().push_back(t);
+    return true;
+  }
+
+  stringstream ss(spec);
+  string group;
+  while ( getline(ss, group, ';') ) {
+    stringstream gs(group);
+    string id;
+    groups.push_back(vector<int>());
+    while ( getline(gs, id, ',') ) {
+      int t = atoi(id.c_str());
+      if ( t < 0 || t >= (int)gSketch.size() ) {
+        cerr << "thread " << id << " has no sketches" << endl;
+        return false;
+      }
+      groups.back().push_back(t);
+    }
+    if ( groups.back().empty() ) groups.pop_back();
+  }
+  return !groups.empty();
+}
+
+/* the sketches of a group, merged per bucket */
+static void MergeGroup(const vector<int>& group, vector<hll_sketch>& merged)
+{
+  merged.assign(gBuckets, hll_sketch());
+  for(size_t i=0; i<group.size(); i++) {
+    for(uint64_t b=0; b<gBuckets; b++) merged[b].merge(gSketch[group[i]][b]);
+  }
+}
+
+/* the mean footprint of windows of k buckets, in lines, over samples start buckets */
+static double Footprint(const vector<hll_sketch>& merged, uint64_t k, int samples)
+{
+  uint64_t starts = gBuckets - k + 1;
+  uint64_t n = (uint64_t)samples < starts ? samples : starts;
+  double sum = 0;
+
+  for(uint64_t i=0; i<n; i++) {
+    uint64_t start = n > 1 ? i * (starts - 1) / (n - 1) : 0;
+    hll_sketch window;
+    for(uint64_t b=start; b<start+k; b++) window.merge(merged[b]);
+    sum += window.estimate();
+  }
+  return n ? sum / n : 0;
+}
+
+/* ===================================================================== */
+/* main */
+/* ===================================================================== */
+
+static int Usage(const char* prog)
+{
+  cerr << "usage: " << prog << " -f profile.bin [-g \"0,1;2,3\"] [-w window,...] [-s samples] [-b line_size]" << endl;
+  return -1;
+}
+
+int main(int argc, char* argv[])
+{
+  string profile;
+  string groups_spec;
+  string windows_spec;
+  int samples = 64;
+  int linesize = 64;
+  int c;
+
+  while ( (c = getopt(argc, argv, "f:g:w:s:b:")) != -1 ) {
+    switch (c) {
+      case 'f': profile = optarg; break;
+      case 'g': groups_spec = optarg; break;
+      case 'w': windows_spec = optarg; break;
+      case 's': samples = atoi(optarg); break;
+      case 'b': linesize = atoi(optarg); break;
+      default: return Usage(argv[0]);
+    }
+  }
+  if ( profile.empty() || samples < 1 || linesize < 1 ) return Usage(argv[0]);
+
+  if ( !ReadProfile(profile) ) return -1;
+
+  vector<vector<int> > groups;
+  if ( !ParseGroups(groups_spec, groups) ) return Usage(argv[0]);
+
+  /* the window lengths, by default powers of 4 from the bucket width to the run */
+  vector<uint64_t> windows;
+  if ( windows_spec.empty() ) {
+    for(uint64_t w=gWidth; w < gWidth * gBuckets; w*=4) windows.push_back(w);
+    windows.push_back(gWidth * gBuckets);
+  } else {
+    stringstream ss(windows_spec);
+    string w;
+    while ( getline(ss, w, ',') ) windows.push_back(strtoull(w.c_str(), NULL, 10));
+  }
+
+  cout << "# accesses " << (uint64_t)gAccesses << ", " << gSketch.size() << " threads, "
+       << gBuckets << " buckets of " << gWidth << " accesses, precision " << gPrecision << endl;
+  cout << "# footprint in bytes of the groups";
+  for(size_t g=0; g<groups.size(); g++) {
+    cout << (g ? "; " : " ");
+    for(size_t i=0; i<groups[g].size(); i++) cout << (i ? "," : "") << groups[g][i];
+  }
+  cout << endl;
+
+  cout << "window\tbuckets";
+  for(size_t g=0; g<groups.size(); g++) cout << "\tg" << g;
+  cout << endl;
+
+  vector<vector<hll_sketch> > merged(groups.size());
+  for(size_t g=0; g<groups.size(); g++) MergeGroup(groups[g], merged[g]);
+
+  for(size_t i=0; i<windows.size(); i++) {
+    /* the whole buckets nearest to the window */
+    uint64_t k = (windows[i] + gWidth / 2) / gWidth;
+    if ( k < 1 ) k = 1;
+    if ( k > gBuckets ) k = gBuckets;
+
+    cout << k * gWidth << "\t" << k;
+    for(size_t g=0; g<groups.size(); g++) {
+      cout << "\t" << setprecision(12) << Footprint(merged[g], k, samples) * linesize;
+    }
+    cout << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,156 @@
+/* sfp-mrc : offline shared cache miss ratio curve predictor
+ *
+ * It reads a sfp profile written by anyk-sfp, anyk-wr-sfp or anyset-fp
+ * (fp.out), and predicts the miss ratio and miss count of a shared cache
+ * for each sharing degree and for groups of threads, as the tools do in
+ * their Fini. See sfp_mrc.H for the conversion.
+ *
+ * A thread set composed by anyset-fp-compose.rb, one footprint per line
+ * in bytes at the window lengths of the sfp profile, can be added with
+ * -c, -n giving the size of that thread set.
+ *
+ * example run:
+ *
+ * sfp-mrc -f fp.out -t 8 -g 2,4 -o mrc.out
+ * anyset-fp-compose.rb -m 8 -l 10 -p 1 -f fp.out -g sg.out --group=1,2 > set.fp
+ * sfp-mrc -f fp.out -t 8 -c set.fp -n 2 -o mrc.out
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sfp_mrc.H"
+
+using namespace std;
+
+/* ===================================================================== */
+/* Profile readers */
+/* ===================================================================== */
+
+/* read the sfp profile into one curve per sharing degree, in lines */
+static bool ReadSfpProfile(const string& filename, int linesize, vector<TFootprintCurve>& degree)
+{
+  ifstream in(filename.c_str());
+  if ( !in.is_open() ) {
+    cerr << "cannot open " << filename << endl;
+    return false;
+  }
+
+  /* first line is "N:<length> ...", second line names the columns */
+  string line;
+  unsigned long long N = 0;
+  getline(in, line);
+  if ( sscanf(line.c_str(), "N:%llu", &N) != 1 ) {
+    cerr << filename << " is not a sfp profile" << endl;
+    return false;
+  }
+  getline(in, line);
+
+  while ( getline(in, line) ) {
+    istringstream ss(line);
+    double ws, fp;
+    if ( !(ss >> ws) ) continue;
+
+    for(size_t i=0; ss >> fp; i++) {
+      if ( i == degree.size() ) degree.push_back(TFootprintCurve());
+      degree[i].push_back(ws, fp / linesize);
+    }
+  }
+
+  for(size_t i=0; i<degree.size(); i++) {
+    degree[i].accesses = N;
+  }
+  return !degree.empty();
+}
+
+/* highest sharing degree with a non-zero footprint */
+static int ObservedThreads(const vector<TFootprintCurve>& degree)
+{
+  int T = 1;
+  for(size_t i=0; i<degree.size(); i++) {
+    if ( degree[i].max_fp() > 0 ) T = i+1;
+  }
+  return T;
+}
+
+/* read a composed thread set footprint, at the window lengths of the profile */
+static bool ReadComposed(const string& filename, int linesize, int T, int n,
+                         const vector<TFootprintCurve>& degree, TFootprintCurve& c)
+{
+  ifstream in(filename.c_str());
+  if ( !in.is_open() ) {
+    cerr << "cannot open " << filename << endl;
+    return false;
+  }
+
+  double share = 1.0 * n / T;
+  double fp;
+  for(size_t i=0; in >> fp && i<degree[0].size(); i++) {
+    c.push_back(degree[0].ws[i] * share, fp / linesize);
+  }
+  c.accesses = degree[0].accesses * share;
+  c.name = "set";
+  return c.size() > 0;
+}
+
+/* ===================================================================== */
+/* main */
+/* ===================================================================== */
+
+static int Usage(const char* prog)
+{
+  cerr << "usage: " << prog << " -f sfp_profile [-o mrc_file] [-t threads] [-g group_sizes] [-b line_size] [-c composed_fp -n set_size]" << endl;
+  return -1;
+}
+
+int main(int argc, char* argv[])
+{
+  string profile;
+  string output = "mrc.out";
+  string groups;
+  string composed;
+  int threads = 0;
+  int linesize = 64;
+  int setsize = 0;
+  int c;
+
+  while ( (c = getopt(argc, argv, "f:o:t:g:b:c:n:")) != -1 ) {
+    switch (c) {
+      case 'f': profile = optarg; break;
+      case 'o': output = optarg; break;
+      case 't': threads = atoi(optarg); break;
+      case 'g': groups = optarg; break;
+      case 'b': linesize = atoi(optarg); break;
+      case 'c': composed = optarg; break;
+      case 'n': setsize = atoi(optarg); break;
+      default: return Usage(argv[0]);
+    }
+  }
+  if ( profile.empty() || linesize < 1 ) return Usage(argv[0]);
+  if ( !composed.empty() && setsize < 1 ) return Usage(argv[0]);
+
+  vector<TFootprintCurve> degree;
+  if ( !ReadSfpProfile(profile, linesize, degree) ) return -1;
+  if ( threads < 1 ) threads = ObservedThreads(degree);
+
+  vector<TFootprintCurve> extra;
+  if ( !composed.empty() ) {
+    TFootprintCurve set;
+    if ( !ReadComposed(composed, linesize, threads, setsize, degree, set) ) return -1;
+    extra.push_back(set);
+  }
+
+  if ( !SFP_WriteMrc(output, degree, threads, SFP_ParseGroups(groups, threads), linesize, extra) ) {
+    cerr << "cannot write " << output << endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,408 @@
+/* sfp-placement : offline thread placement optimizer
+ *
+ * It reads the sharing graph written by anyset-fp (sg.out.<pillar>, the
+ * average footprint of the data accessed by exactly each thread set at
+ * the pillar window lengths) and a machine topology, and searches the
+ * thread to core assignment that minimizes the predicted misses of all
+ * caches of the topology.
+ *
+ * The topology is a list of cache levels, each given as
+ * name:cores_per_cache:size_kb[:weight], e.g. l2:2:1024,llc:8:16384 for
+ * two cores per L2 and eight cores per socket wide LLC. The threads on
+ * the cores of one cache form a thread set S. The footprint of S at a
+ * pillar is the footprint of every thread set that intersects S, and
+ * the misses of the cache are predicted from the footprint curve of S
+ * over the pillars by the higher order theory of locality (sfp_mrc.H).
+ * The cost of a placement is the weighted sum of the predicted misses
+ * per access over all caches.
+ *
+ * Assignments are searched exhaustively when there are few enough of
+ * them, otherwise by local search: starting from random placements,
+ * pairs of threads (or a thread and a free core) are swapped as long as
+ * the cost drops.
+ *
+ * The placement is written as one line per thread, thread id, cpu id and
+ * affinity mask in hex, followed by a GOMP_CPU_AFFINITY line.
+ *
+ * example run:
+ *
+ * sfp-placement -g sg.out -l 12 -n 8 -t l2:2:1024,llc:4:8192 -o affinity.out
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sfp_mrc.H"
+
+using namespace std;
+
+#define MAX_THREADS 64
+
+/* ===================================================================== */
+/* Sharing graph */
+/* ===================================================================== */
+
+/* the footprint in lines of the data accessed by exactly a thread set */
+struct TSharingEntry {
+  uint64_t set;
+  double fp;
+};
+
+/* window lengths of the pillars, and the sharing graph at each pillar */
+vector<double> gPillarLengths;
+vector< vector<TSharingEntry> > gSharingGraph;
+
+/* thread count, one more than the highest thread in the sharing graph */
+int gThreads = 0;
+
+/* read sg.out.<e> for e from the lowest pillar on, pillar lengths grow by 4x as in anyset-fp */
+static bool ReadSharingGraph(const string& prefix, int lowest)
+{
+  for(int e=lowest; e<64; e++) {
+    ostringstream filename;
+    filename << prefix << "." << e;
+
+    ifstream in(filename.str().c_str());
+    if ( !in.is_open() ) break;
+
+    vector<TSharingEntry> graph;
+    string bits;
+    double fp;
+    while ( in >> bits >> fp ) {
+
+      /* the bit string starts from thread 0 */
+      TSharingEntry entry;
+      entry.set = 0;
+      for(size_t i=0; i<bits.size() && i<MAX_THREADS; i++) {
+        if ( bits[i] == '1' ) {
+          entry.set |= (uint64_t)1 << i;
+          if ( (int)i+1 > gThreads ) gThreads = i+1;
+        }
+      }
+      entry.fp = fp;
+      graph.push_back(entry);
+    }
+
+    gSharingGraph.push_back(graph);
+    gPillarLengths.push_back((double)((uint64_t)1 << lowest) * ((uint64_t)1 << (2*(e-lowest))));
+  }
+
+  if ( gSharingGraph.empty() ) {
+    cerr << "cannot open " << prefix << "." << lowest << endl;
+    return false;
+  }
+  return true;
+}
+
+/* footprint curve of the threads in set over the pillars */
+static TFootprintCurve SetFootprint(uint64_t set)
+{
+  TFootprintCurve c;
+  c.push_back(0, 0);
+  for(size_t j=0; j<gSharingGraph.size(); j++) {
+    double fp = 0;
+    for(size_t k=0; k<gSharingGraph[j].size(); k++) {
+      if ( gSharingGraph[j][k].set & set ) fp += gSharingGraph[j][k].fp;
+    }
+    c.push_back(gPillarLengths[j], fp);
+  }
+  return c;
+}
+
+/* ===================================================================== */
+/* Topology and cost */
+/* ===================================================================== */
+
+struct TCacheLevel {
+  string name;
+  int cores;      /* cores sharing one cache */
+  double lines;   /* cache size in lines */
+  double weight;
+
+  /* predicted misses per access of a cache holding a thread set */
+  map<uint64_t, double> memo;
+
+  double misses(uint64_t set)
+  {
+    if ( set == 0 ) return 0;
+
+    map<uint64_t, double>::iterator i = memo.find(set);
+    if ( i != memo.end() ) return i->second;
+
+    double mr = SetFootprint(set).miss_ratio(lines);
+    memo[set] = mr;
+    return mr;
+  }
+};
+
+vector<TCacheLevel> gLevels;
+int gCores = 0;
+
+/* parse name:cores_per_cache:size_kb[:weight],... */
+static bool ParseTopology(const string& s, int linesize)
+{
+  istringstream list(s);
+  string level;
+  while ( getline(list, level, ',') ) {
+    istringstream fields(level);
+    string name, cores, size, weight;
+    getline(fields, name, ':');
+    getline(fields, cores, ':');
+    getline(fields, size, ':');
+    getline(fields, weight, ':');
+
+    TCacheLevel l;
+    l.name = name;
+    l.cores = atoi(cores.c_str());
+    l.lines = atof(size.c_str()) * 1024 / linesize;
+    l.weight = weight.empty() ? 1 : atof(weight.c_str());
+    if ( l.cores < 1 || l.lines <= 0 ) {
+      cerr << "bad cache level " << level << endl;
+      return false;
+    }
+    gLevels.push_back(l);
+  }
+  return !gLevels.empty();
+}
+
+/* cost of a placement, core[t] is the core of thread t */
+static double PlacementCost(const vector<int>& core)
+{
+  double cost = 0;
+  for(size_t l=0; l<gLevels.size(); l++) {
+    int caches = (gCores + gLevels[l].cores - 1) / gLevels[l].cores;
+    vector<uint64_t> sets(caches, 0);
+    for(size_t t=0; t<core.size(); t++) {
+      sets[core[t] / gLevels[l].cores] |= (uint64_t)1 << t;
+    }
+    for(int c=0; c<caches; c++) {
+      cost += gLevels[l].weight * gLevels[l].misses(sets[c]);
+    }
+  }
+  return cost;
+}
+
+/* ===================================================================== */
+/* Search */
+/* ===================================================================== */
+
+/* number of assignments of T threads to C cores, C!/(C-T)!, capped at limit */
+static double Assignments(int T, int C, double limit)
+{
+  double n = 1;
+  for(int i=0; i<T && n<=limit; i++) n *= (C-i);
+  return n;
+}
+
+static void ExhaustiveSearch(vector<int>& core, vector<bool>& used, size_t t,
+                             vector<int>& best, double& best_cost)
+{
+  if ( t == core.size() ) {
+    double cost = PlacementCost(core);
+    if ( cost < best_cost ) {
+      best_cost = cost;
+      best = core;
+    }
+    return;
+  }
+
+  for(int c=0; c<gCores; c++) {
+    if ( used[c] ) continue;
+    used[c] = true;
+    core[t] = c;
+    ExhaustiveSearch(core, used, t+1, best, best_cost);
+    used[c] = false;
+  }
+}
+
+/* swap based hill climbing from a placement, returns its cost */
+static double LocalSearch(vector<int>& core)
+{
+  double cost = PlacementCost(core);
+
+  /* owner[c] is the thread on core c, -1 if free */
+  vector<int> owner(gCores, -1);
+  for(size_t t=0; t<core.size(); t++) owner[core[t]] = t;
+
+  bool improved = true;
+  while ( improved ) {
+    improved = false;
+    for(size_t t=0; t<core.size(); t++) {
+      for(int c=0; c<gCores; c++) {
+        int from = core[t];
+        int other = owner[c];
+        if ( c == from ) continue;
+
+        /* move t to core c, and the thread on c, if any, to t's core */
+        core[t] = c;
+        if ( other >= 0 ) core[other] = from;
+
+        double moved = PlacementCost(core);
+        if ( moved < cost - 1e-12 ) {
+          cost = moved;
+          owner[c] = t;
+          owner[from] = other;
+          improved = true;
+        } else {
+          core[t] = from;
+          if ( other >= 0 ) core[other] = c;
+        }
+      }
+    }
+  }
+  return cost;
+}
+
+/* ===================================================================== */
+/* Output */
+/* ===================================================================== */
+
+/* affinity mask of one cpu, in the comma separated 32 bit hex words of Linux cpumasks */
+static string CpuMask(int cpu)
+{
+  ostringstream mask;
+  mask << hex << ((uint32_t)1 << (cpu%32));
+  for(int w=cpu/32; w>0; w--) mask << ",00000000";
+  return mask.str();
+}
+
+static void WritePlacement(const string& filename, const vector<int>& core, const vector<int>& cpus)
+{
+  ofstream out(filename.c_str());
+
+  out << "# thread\tcpu\tmask" << endl;
+  for(size_t t=0; t<core.size(); t++) {
+    out << t << "\t" << cpus[core[t]] << "\t" << CpuMask(cpus[core[t]]) << endl;
+  }
+
+  out << "GOMP_CPU_AFFINITY=\"";
+  for(size_t t=0; t<core.size(); t++) {
+    out << (t ? " " : "") << cpus[core[t]];
+  }
+  out << "\"" << endl;
+  out.close();
+}
+
+static void ReportPlacement(ostream& out, const char* name, const vector<int>& core)
+{
+  out << name << ":";
+  for(size_t t=0; t<core.size(); t++) out << " " << core[t];
+  out << endl;
+
+  for(size_t l=0; l<gLevels.size(); l++) {
+    int caches = (gCores + gLevels[l].cores - 1) / gLevels[l].cores;
+    vector<uint64_t> sets(caches, 0);
+    for(size_t t=0; t<core.size(); t++) {
+      sets[core[t] / gLevels[l].cores] |= (uint64_t)1 << t;
+    }
+
+    double misses = 0;
+    for(int c=0; c<caches; c++) misses += gLevels[l].misses(sets[c]);
+    out << "  " << gLevels[l].name << " misses per access: " << setprecision(6) << misses << endl;
+  }
+  out << "  cost: " << PlacementCost(core) << endl;
+}
+
+/* ===================================================================== */
+/* main */
+/* ===================================================================== */
+
+static int Usage(const char* prog)
+{
+  cerr << "usage: " << prog << " -g sharing_graph -n cores -t name:cores_per_cache:size_kb[:weight],..."
+       << " [-l lowest_pillar] [-m threads] [-c cpu_list] [-b line_size] [-x exhaustive_limit] [-r restarts] [-s seed] [-o affinity_file]" << endl;
+  return -1;
+}
+
+int main(int argc, char* argv[])
+{
+  string graph;
+  string topology;
+  string cpulist;
+  string output = "affinity.out";
+  int lowest = 12;
+  int threads = 0;
+  int linesize = 64;
+  double limit = 100000;
+  int restarts = 16;
+  unsigned seed = 1;
+  int c;
+
+  while ( (c = getopt(argc, argv, "g:n:t:l:m:c:b:x:r:s:o:")) != -1 ) {
+    switch (c) {
+      case 'g': graph = optarg; break;
+      case 'n': gCores = atoi(optarg); break;
+      case 't': topology = optarg; break;
+      case 'l': lowest = atoi(optarg); break;
+      case 'm': threads = atoi(optarg); break;
+      case 'c': cpulist = optarg; break;
+      case 'b': linesize = atoi(optarg); break;
+      case 'x': limit = atof(optarg); break;
+      case 'r': restarts = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'o': output = optarg; break;
+      default: return Usage(argv[0]);
+    }
+  }
+  if ( graph.empty() || topology.empty() || gCores < 1 || linesize < 1 ) return Usage(argv[0]);
+
+  if ( !ReadSharingGraph(graph, lowest) ) return -1;
+  if ( !ParseTopology(topology, linesize) ) return Usage(argv[0]);
+  if ( threads > gThreads ) gThreads = threads;
+  if ( gThreads > gCores || gThreads > MAX_THREADS ) {
+    cerr << gThreads << " threads do not fit on " << gCores << " cores" << endl;
+    return -1;
+  }
+
+  /* os cpu id of every core, the identity by default */
+  vector<int> cpus;
+  istringstream list(cpulist);
+  string cpu;
+  while ( getline(list, cpu, ',') ) cpus.push_back(atoi(cpu.c_str()));
+  for(int i=cpus.size(); i<gCores; i++) cpus.push_back(i);
+
+  /* the default placement, thread t on core t */
+  vector<int> identity(gThreads);
+  for(int t=0; t<gThreads; t++) identity[t] = t;
+
+  vector<int> best = identity;
+  double best_cost = PlacementCost(identity);
+
+  if ( Assignments(gThreads, gCores, limit) <= limit ) {
+    vector<int> core(gThreads);
+    vector<bool> used(gCores, false);
+    ExhaustiveSearch(core, used, 0, best, best_cost);
+  } else {
+    srand(seed);
+    for(int r=0; r<=restarts; r++) {
+      vector<int> core = identity;
+      if ( r > 0 ) {
+        vector<int> perm(gCores);
+        for(int i=0; i<gCores; i++) perm[i] = i;
+        for(int i=gCores-1; i>0; i--) swap(perm[i], perm[rand() % (i+1)]);
+        for(int t=0; t<gThreads; t++) core[t] = perm[t];
+      }
+      double cost = LocalSearch(core);
+      if ( cost < best_cost ) {
+        best_cost = cost;
+        best = core;
+      }
+    }
+  }
+
+  ReportPlacement(cout, "default", identity);
+  ReportPlacement(cout, "best", best);
+  WritePlacement(output, best, cpus);
+
+  return 0;
+}
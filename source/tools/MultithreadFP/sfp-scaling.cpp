@@ -0,0 +1,231 @@
+/* sfp-scaling : offline thread count scaling predictor
+ *
+ * It reads the binary profile (fp.bin) of an anyk-sfp run at T threads
+ * and extrapolates the aggregate and shared footprint to other thread
+ * counts, to find the thread count at which the working set spills
+ * out of a given cache.
+ *
+ * The extrapolation assumes weak scaling, every thread doing the same
+ * work at any thread count. With fp_d the footprint of the data shared
+ * by exactly d threads, data shared by fewer than T threads, private
+ * data and data shared among neighbours, is replicated with the thread
+ * count. Data shared by all threads stays the same data.
+ *
+ * Thread j at T' threads replays thread j mod T of the profiled run. In
+ * a window of w accesses a thread issues w/T' of them, the share it
+ * issued in a window of w T / T' accesses of the profiled run. The
+ * replicated data is split among the profiled threads by their solo
+ * footprints s_t (anyk-sfp -solo), so at T' threads
+ *
+ *   fp'(w) = sum_{j<T'} c(j mod T) sum_{d<T} fp_d(v) + fp_T(w)
+ *   c(t) = T s_t(v) / sum_u s_u(v),  v = w T / T'
+ *
+ * Without the solo curves the threads are taken as symmetric, c = 1,
+ * and fp'(w) = sum_{d<T} (T'/T) fp_d(v) + fp_T(w). The report also
+ * gives the largest solo footprint of the threads in use.
+ *
+ * For every thread count, the report gives the total and shared
+ * footprint, the shortest window whose footprint fills the cache, and
+ * the predicted miss ratio (sfp_mrc.H). The knee is the first thread
+ * count whose miss ratio reaches the threshold.
+ *
+ * example run:
+ *
+ * sfp-scaling -f fp.bin -c 8192 -t 32 -e 0.01
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sfp_profile.H"
+#include "sfp_mrc.H"
+
+using namespace std;
+
+/* footprint of the data shared by exactly d threads, exact[d-1], in lines */
+vector<TFootprintCurve> gExact;
+
+/* footprint of every thread alone, solo[t], in lines, empty if not profiled */
+vector<TFootprintCurve> gSolo;
+
+/* thread count of the profiled run, and the window lengths */
+int gThreads = 0;
+vector<double> gWindows;
+double gAccesses = 0;
+
+/* ===================================================================== */
+/* Profile */
+/* ===================================================================== */
+
+static bool ReadProfile(const string& filename)
+{
+  TProfileReader reader;
+  if ( !reader.open(filename) ) {
+    cerr << "cannot read profile " << filename << endl;
+    return false;
+  }
+  gAccesses = reader.get_header().length;
+
+  TProfileSection s;
+  while ( reader.next_section(s) ) {
+    if ( s.type == SECTION_SOLO_CURVES && s.id == 0 && s.cols >= 2 ) {
+      vector<double> data;
+      reader.read_payload(s, data);
+      gSolo.assign(s.cols - 1, TFootprintCurve());
+      for(uint64_t r=0; r<s.rows; r++) {
+        for(size_t t=0; t<gSolo.size(); t++) gSolo[t].push_back(data[r*s.cols], data[r*s.cols+1+t]);
+      }
+      continue;
+    }
+
+    if ( s.type != SECTION_SFP_CURVES || s.id != 0 || s.cols < 2 ) {
+      reader.skip_payload(s);
+      continue;
+    }
+
+    vector<double> data;
+    reader.read_payload(s, data);
+
+    /* the columns hold the data shared by at least d threads */
+    gThreads = s.cols - 1;
+    gExact.assign(gThreads, TFootprintCurve());
+    for(uint64_t r=0; r<s.rows; r++) {
+      const double* row = &data[r*s.cols];
+      gWindows.push_back(row[0]);
+      for(int d=1; d<=gThreads; d++) {
+        double next = (d < gThreads) ? row[d+1] : 0;
+        gExact[d-1].push_back(row[0], row[d] - next);
+      }
+    }
+  }
+  reader.close();
+
+  if ( gThreads == 0 ) {
+    cerr << filename << " has no sfp curves" << endl;
+    return false;
+  }
+
+  /* the solo curves must match the threads and windows of the sfp curves */
+  if ( !gSolo.empty() && ((int)gSolo.size() != gThreads || gSolo[0].size() != gWindows.size()) ) {
+    cerr << filename << " has solo curves of another run, taking the threads as symmetric" << endl;
+    gSolo.clear();
+  }
+  return true;
+}
+
+/* ===================================================================== */
+/* Extrapolation */
+/* ===================================================================== */
+
+/* the replicated data of the n threads in window i over that of the T profiled threads */
+static double Replicas(int n, size_t i)
+{
+  double all = 0, used = 0;
+  if ( gSolo.empty() ) return 1.0 * n / gThreads;
+
+  for(int t=0; t<gThreads; t++) all += gSolo[t].fp[i];
+  if ( all <= 0 ) return 1.0 * n / gThreads;
+  for(int j=0; j<n; j++) used += gSolo[j % gThreads].fp[i];
+  return used / all;
+}
+
+/* the total and the shared footprint at n threads */
+static void Extrapolate(int n, TFootprintCurve& total, TFootprintCurve& shared)
+{
+  double scale = 1.0 * n / gThreads;
+
+  total.accesses = shared.accesses = gAccesses * scale;
+  /* the windows stretch with the run, window i holds the same per thread accesses */
+  for(size_t i=0; i<gWindows.size(); i++) {
+    double w = gWindows[i] * scale;
+    double replicas = Replicas(n, i);
+    double fp_total = 0, fp_shared = 0;
+
+    for(int d=1; d<=gThreads; d++) {
+      double fp = (d < gThreads || gThreads == 1) ? replicas * gExact[d-1].fp[i] : gExact[d-1].at(w);
+      fp_total += fp;
+      if ( d > 1 ) fp_shared += fp;
+    }
+    total.push_back(w, fp_total);
+    shared.push_back(w, fp_shared);
+  }
+}
+
+/* the largest solo footprint of the threads in use at n threads, 0 if not profiled */
+static double SoloMax(int n)
+{
+  double top = 0;
+  for(int t=0; t<n && t<(int)gSolo.size(); t++) {
+    if ( gSolo[t].max_fp() > top ) top = gSolo[t].max_fp();
+  }
+  return top;
+}
+
+/* ===================================================================== */
+/* main */
+/* ===================================================================== */
+
+static int Usage(const char* prog)
+{
+  cerr << "usage: " << prog << " -f profile.bin -c cache_kb [-t max_threads] [-e miss_ratio_threshold] [-b line_size]" << endl;
+  return -1;
+}
+
+int main(int argc, char* argv[])
+{
+  string profile;
+  double cache_kb = 0;
+  int max_threads = 0;
+  double threshold = 0.01;
+  int linesize = 64;
+  int c;
+
+  while ( (c = getopt(argc, argv, "f:c:t:e:b:")) != -1 ) {
+    switch (c) {
+      case 'f': profile = optarg; break;
+      case 'c': cache_kb = atof(optarg); break;
+      case 't': max_threads = atoi(optarg); break;
+      case 'e': threshold = atof(optarg); break;
+      case 'b': linesize = atoi(optarg); break;
+      default: return Usage(argv[0]);
+    }
+  }
+  if ( profile.empty() || cache_kb <= 0 || linesize < 1 ) return Usage(argv[0]);
+
+  if ( !ReadProfile(profile) ) return -1;
+  if ( max_threads < 1 ) max_threads = 2 * gThreads;
+
+  double lines = cache_kb * 1024 / linesize;
+  int knee = 0;
+
+  cout << "# profiled at " << gThreads << " threads, cache " << (uint64_t)(lines * linesize) << " bytes" << endl;
+  cout << "# " << (gSolo.empty() ? "symmetric threads, no solo curves" : "replicated data split by the solo curves") << endl;
+  cout << "threads\ttotal\tshared\tsolo_max\tfill_ws\tmr" << endl;
+
+  for(int n=1; n<=max_threads; n++) {
+    TFootprintCurve total, shared;
+    Extrapolate(n, total, shared);
+
+    double fill = total.fill_window(lines);
+    double mr = total.miss_ratio(lines);
+    if ( knee == 0 && mr >= threshold ) knee = n;
+
+    cout << n << "\t" << setprecision(12) << total.max_fp() * linesize
+         << "\t" << shared.max_fp() * linesize
+         << "\t" << SoloMax(n) * linesize
+         << "\t" << (fill < 0 ? 0 : (uint64_t)(fill + 0.5))
+         << "\t" << setprecision(6) << mr << endl;
+  }
+
+  cout << endl << "knee: ";
+  if ( knee ) cout << knee << " threads" << endl;
+  else cout << "none up to " << max_threads << " threads" << endl;
+
+  return 0;
+}
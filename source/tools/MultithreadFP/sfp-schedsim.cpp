@@ -0,0 +1,666 @@
+/* sfp-schedsim : offline schedule simulator for task parallel programs
+ *
+ * It replays the task trace recorded by sfp-scheduler (-trace 1) under
+ * alternative schedules and reports the footprint each schedule puts
+ * on the caches, without re-running the instrumented program.
+ *
+ * The work of a task is its access count. A child becomes ready when
+ * its parent has done the share of work that preceded the child's
+ * start in the recorded run. The recorded waits of a task (taskwait,
+ * the end of a parallel region, wait_for_all, sync or SFP_TaskWait)
+ * sit at the same share of its work, and each joins the children
+ * started since the previous wait: the task blocks there until they
+ * are done, and the worker finishing the last of them resumes it. The
+ * children started after the last wait that finished before their
+ * parent join at its end, the others are detached.
+ *
+ * Policies:
+ *   bf : breadth-first, spawned tasks go to one global FIFO queue
+ *   wf : work-first, the spawner runs the child and leaves its
+ *        continuation in its deque, idle workers steal from random victims
+ *   hf : help-first, the spawner keeps running and pushes the child
+ *   la : work-first with locality-aware stealing, the thief takes the
+ *        oldest task of the victim whose lines overlap most with the
+ *        lines of the thief's last task
+ *
+ * For every window length, it reports the footprint of all workers
+ * together and the mean and max footprint of one worker, averaged
+ * over consecutive windows of the simulated time. A window holds the
+ * lines of the work the tasks did in it: the lines whose first to last
+ * access in the task, counted in the task's accesses, overlaps that
+ * share of the task. A line reused across the whole task is held in
+ * every window of the task.
+ *
+ * example run:
+ *
+ * sfp-schedsim -f ldesc.bin -w 8 -s bf,wf,hf,la -l 10 > schedsim.out
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "sfp_profile.H"
+
+using namespace std;
+
+/* ===================================================================== */
+/* Task trace */
+/* ===================================================================== */
+
+struct TTask {
+  int64_t id;
+  int64_t parent;
+  int64_t start;
+  int64_t end;
+  uint64_t work;
+
+  /* index of parent in the task array, -1 for roots */
+  int parent_idx;
+
+  /* children in recorded start order, and the parent's work done before each */
+  vector<int> children;
+  vector<uint64_t> spawn_at;
+
+  /* the recorded wait times, the parent's work done before each, and the
+   * wait joining each child, waits.size() for the end, -1 if detached
+   */
+  vector<int64_t> waits;
+  vector<uint64_t> wait_at;
+  vector<int> join;
+
+  /* sorted cache line addresses, and the first and last access of the task to each */
+  vector<int64_t> lines;
+  vector<int64_t> first;
+  vector<int64_t> last;
+};
+
+vector<TTask> gTasks;
+vector<int> gRoots;
+
+static bool StartsBefore(int a, int b)
+{
+  return gTasks[a].start < gTasks[b].start;
+}
+
+/* the work a task has done at a recorded time, its share of the task's span */
+static uint64_t WorkAt(const TTask& t, int64_t time)
+{
+  double span = t.end > t.start ? (double)(t.end - t.start) : 1.0;
+  double frac = (double)(time - t.start) / span;
+  if ( frac < 0 ) frac = 0;
+  if ( frac > 1 ) frac = 1;
+  return (uint64_t)(frac * t.work);
+}
+
+bool ReadTrace(const string& filename)
+{
+  TProfileReader reader;
+  if ( !reader.open(filename) ) {
+    cerr << "can not read profile " << filename << endl;
+    return false;
+  }
+
+  map<int64_t, int> index;
+  map<int64_t, TTask> lines;
+  map<int64_t, vector<int64_t> > waits;
+  TProfileSection s;
+
+  while ( reader.next_section(s) ) {
+
+    if ( s.type == SECTION_TASK_DAG ) {
+
+      vector<int64_t> dag;
+      reader.read_payload(s, dag);
+      for(uint64_t r=0; r<s.rows; r++) {
+
+        const int64_t* row = &dag[r*s.cols];
+
+        /* task 0 is the placeholder for code outside of tasks */
+        if ( row[TASK_DAG_ID] == 0 ) continue;
+
+        TTask t;
+        t.id = row[TASK_DAG_ID];
+        t.parent = row[TASK_DAG_PARENT];
+        t.start = row[TASK_DAG_START];
+        t.end = row[TASK_DAG_END];
+        t.work = row[TASK_DAG_ACCESSES] > 0 ? row[TASK_DAG_ACCESSES] : 1;
+        t.parent_idx = -1;
+
+        index[t.id] = gTasks.size();
+        gTasks.push_back(t);
+      }
+
+    } else if ( s.type == SECTION_TASK_LINES ) {
+
+      vector<int64_t> rows;
+      reader.read_payload(s, rows);
+      TTask& l = lines[s.id];
+      for(uint64_t r=0; r<s.rows && s.cols>=TASK_LINES_COLS; r++) {
+        l.lines.push_back(rows[r*s.cols+TASK_LINES_ADDRESS]);
+        l.first.push_back(rows[r*s.cols+TASK_LINES_FIRST]);
+        l.last.push_back(rows[r*s.cols+TASK_LINES_LAST]);
+      }
+
+    } else if ( s.type == SECTION_TASK_WAITS ) {
+
+      vector<int64_t> rows;
+      reader.read_payload(s, rows);
+      for(uint64_t r=0; r<s.rows && s.cols>=1; r++) {
+        waits[s.id].push_back(rows[r*s.cols]);
+      }
+
+    } else {
+
+      reader.skip_payload(s);
+    }
+  }
+  reader.close();
+
+  if ( gTasks.empty() ) {
+    cerr << "no task trace in " << filename << ", run sfp-scheduler with -trace 1" << endl;
+    return false;
+  }
+
+  for(size_t i=0; i<gTasks.size(); i++) {
+    TTask& t = gTasks[i];
+    t.lines.swap(lines[t.id].lines);
+    t.first.swap(lines[t.id].first);
+    t.last.swap(lines[t.id].last);
+    t.waits.swap(waits[t.id]);
+    sort(t.waits.begin(), t.waits.end());
+
+    map<int64_t, int>::iterator p = index.find(t.parent);
+    if ( p == index.end() || p->second == (int)i ) {
+      gRoots.push_back(i);
+    } else {
+      t.parent_idx = p->second;
+      gTasks[p->second].children.push_back(i);
+    }
+  }
+
+  sort(gRoots.begin(), gRoots.end(), StartsBefore);
+
+  /* spawn and wait points from the recorded times */
+  for(size_t i=0; i<gTasks.size(); i++) {
+    TTask& t = gTasks[i];
+    sort(t.children.begin(), t.children.end(), StartsBefore);
+
+    for(size_t k=0; k<t.children.size(); k++) {
+      const TTask& c = gTasks[t.children[k]];
+      t.spawn_at.push_back(WorkAt(t, c.start));
+
+      /* the first wait after the child started joins it */
+      size_t j = lower_bound(t.waits.begin(), t.waits.end(), c.start) - t.waits.begin();
+      if ( j == t.waits.size() && c.end > t.end ) t.join.push_back(-1);
+      else t.join.push_back(j);
+    }
+    for(size_t j=0; j<t.waits.size(); j++) {
+      t.wait_at.push_back(WorkAt(t, t.waits[j]));
+    }
+  }
+
+  return true;
+}
+
+/* ===================================================================== */
+/* Simulation */
+/* ===================================================================== */
+
+enum TPolicy {
+  POLICY_BF = 0,
+  POLICY_WF,
+  POLICY_HF,
+  POLICY_LA
+};
+
+/* a (partially) executed task */
+struct TFrame {
+  int task;
+  uint64_t done;       // work done
+  size_t next_child;   // next child to spawn
+  size_t next_wait;    // next wait to pass
+};
+
+/* a piece of a task executed on a worker, from the task's work done at begin */
+struct TSegment {
+  int task;
+  int worker;
+  uint64_t begin;
+  uint64_t end;
+  uint64_t done;
+};
+
+struct TWorker {
+  bool busy;
+  TFrame frame;
+  uint64_t since;      // start of the current segment
+  deque<TFrame> dq;    // bottom is back
+  int last_task;
+};
+
+class TScheduleSim
+{
+
+public:
+
+  TScheduleSim(TPolicy _policy, int _workers, unsigned seed) :
+    policy(_policy), workers(_workers), now(0)
+  {
+    srand(seed);
+  }
+
+  uint64_t run()
+  {
+    w.assign(workers, TWorker());
+    for(int i=0; i<workers; i++) {
+      w[i].busy = false;
+      w[i].last_task = -1;
+    }
+    pending.assign(gTasks.size(), vector<int>());
+    for(size_t t=0; t<gTasks.size(); t++) pending[t].assign(gTasks[t].waits.size() + 1, 0);
+    blocked.assign(gTasks.size(), false);
+    blocked_frame.assign(gTasks.size(), TFrame());
+    segments.clear();
+    now = 0;
+
+    /* the roots are spawned by the initial thread, on worker 0 */
+    for(size_t r=0; r<gRoots.size(); r++) {
+      make_ready(0, gRoots[r]);
+    }
+
+    for(;;) {
+
+      for(int i=0; i<workers; i++) {
+        if ( !w[i].busy ) find_work(i);
+      }
+
+      /* the worker with the nearest event */
+      int next = -1;
+      uint64_t at = 0;
+      for(int i=0; i<workers; i++) {
+        if ( !w[i].busy ) continue;
+        uint64_t t = now + until_event(w[i].frame);
+        if ( next == -1 || t < at ) {
+          next = i;
+          at = t;
+        }
+      }
+      if ( next == -1 ) break;
+
+      /* advance all busy workers to the event */
+      for(int i=0; i<workers; i++) {
+        if ( w[i].busy ) w[i].frame.done += at - now;
+      }
+      now = at;
+
+      event(next);
+    }
+
+    return now;
+  }
+
+  inline const vector<TSegment>& get_segments() const { return segments; }
+
+private:
+
+  /* a spawn comes before a wait at the same point, the child started before the wait */
+  inline bool spawn_next(const TFrame& f) const
+  {
+    const TTask& t = gTasks[f.task];
+    if ( f.next_child >= t.children.size() ) return false;
+    return f.next_wait >= t.waits.size() || t.spawn_at[f.next_child] <= t.wait_at[f.next_wait];
+  }
+
+  inline uint64_t until_event(const TFrame& f) const
+  {
+    const TTask& t = gTasks[f.task];
+    uint64_t at = t.work;
+    if ( spawn_next(f) ) at = t.spawn_at[f.next_child];
+    else if ( f.next_wait < t.waits.size() ) at = t.wait_at[f.next_wait];
+    return at - min(f.done, at);
+  }
+
+  void start(int i, const TFrame& f)
+  {
+    w[i].busy = true;
+    w[i].frame = f;
+    w[i].since = now;
+  }
+
+  void stop(int i)
+  {
+    TSegment seg;
+    seg.task = w[i].frame.task;
+    seg.worker = i;
+    seg.begin = w[i].since;
+    seg.end = now;
+    seg.done = w[i].frame.done - (seg.end - seg.begin);
+    if ( seg.end > seg.begin ) segments.push_back(seg);
+
+    w[i].busy = false;
+    w[i].last_task = w[i].frame.task;
+  }
+
+  static TFrame new_frame(int task)
+  {
+    TFrame f;
+    f.task = task;
+    f.done = 0;
+    f.next_child = 0;
+    f.next_wait = 0;
+    return f;
+  }
+
+  void make_ready(int i, const TFrame& f)
+  {
+    if ( policy == POLICY_BF ) fifo.push_back(f);
+    else w[i].dq.push_back(f);
+  }
+
+  inline void make_ready(int i, int task) { make_ready(i, new_frame(task)); }
+
+  void event(int i)
+  {
+    TFrame& f = w[i].frame;
+    const TTask& t = gTasks[f.task];
+
+    /* spawn the next child */
+    if ( spawn_next(f) ) {
+
+      size_t k = f.next_child++;
+      int child = t.children[k];
+      if ( t.join[k] != -1 ) pending[f.task][t.join[k]]++;
+
+      if ( policy == POLICY_WF || policy == POLICY_LA ) {
+        TFrame cont = f;
+        stop(i);
+        w[i].dq.push_back(cont);
+        start(i, new_frame(child));
+      } else {
+        make_ready(i, child);
+      }
+      return;
+    }
+
+    /* a wait, passed if its children are done */
+    if ( f.next_wait < t.waits.size() ) {
+      if ( pending[f.task][f.next_wait] == 0 ) {
+        f.next_wait++;
+        return;
+      }
+      int task = f.task;
+      blocked_frame[task] = f;
+      blocked[task] = true;
+      stop(i);
+      return;
+    }
+
+    /* the task ends, or waits for its children */
+    int task = f.task;
+    stop(i);
+    if ( pending[task][t.waits.size()] > 0 ) {
+      blocked_frame[task] = f;
+      blocked[task] = true;
+    } else {
+      finish(i, task);
+    }
+  }
+
+  /* completing a task on worker i may release its parent blocked on it */
+  void finish(int i, int task)
+  {
+    for(;;) {
+      int p = gTasks[task].parent_idx;
+      if ( p == -1 ) return;
+
+      const TTask& t = gTasks[p];
+      size_t k = find(t.children.begin(), t.children.end(), task) - t.children.begin();
+      int j = t.join[k];
+      if ( j == -1 || --pending[p][j] > 0 || !blocked[p] || blocked_frame[p].next_wait != (size_t)j ) return;
+
+      blocked[p] = false;
+      if ( j < (int)t.waits.size() ) {
+        /* the worker that finished the last child resumes the parent after the wait */
+        TFrame f = blocked_frame[p];
+        f.next_wait++;
+        make_ready(i, f);
+        return;
+      }
+
+      /* the parent was waiting at its end, it completes too */
+      task = p;
+    }
+  }
+
+  void find_work(int i)
+  {
+    if ( policy == POLICY_BF ) {
+      if ( fifo.empty() ) return;
+      TFrame f = fifo.front();
+      fifo.pop_front();
+      start(i, f);
+      return;
+    }
+
+    /* own deque first, newest task */
+    if ( !w[i].dq.empty() ) {
+      TFrame f = w[i].dq.back();
+      w[i].dq.pop_back();
+      start(i, f);
+      return;
+    }
+
+    /* steal the oldest task of a victim */
+    vector<int> victims;
+    for(int v=0; v<workers; v++) {
+      if ( v != i && !w[v].dq.empty() ) victims.push_back(v);
+    }
+    if ( victims.empty() ) return;
+
+    int victim = victims[rand() % victims.size()];
+    if ( policy == POLICY_LA && w[i].last_task != -1 ) {
+      size_t best = 0;
+      for(size_t k=0; k<victims.size(); k++) {
+        size_t o = overlap(gTasks[w[i].last_task].lines, gTasks[w[victims[k]].dq.front().task].lines);
+        if ( o > best ) {
+          best = o;
+          victim = victims[k];
+        }
+      }
+    }
+
+    TFrame f = w[victim].dq.front();
+    w[victim].dq.pop_front();
+    start(i, f);
+  }
+
+  static size_t overlap(const vector<int64_t>& a, const vector<int64_t>& b)
+  {
+    size_t n = 0;
+    vector<int64_t>::const_iterator x = a.begin(), y = b.begin();
+    while ( x != a.end() && y != b.end() ) {
+      if ( *x < *y ) x++;
+      else if ( *y < *x ) y++;
+      else { n++; x++; y++; }
+    }
+    return n;
+  }
+
+private:
+
+  TPolicy policy;
+  int workers;
+  uint64_t now;
+
+  vector<TWorker> w;
+  deque<TFrame> fifo;
+  vector<vector<int> > pending;
+  vector<bool> blocked;
+  vector<TFrame> blocked_frame;
+  vector<TSegment> segments;
+
+};
+
+/* ===================================================================== */
+/* Footprint of a schedule */
+/* ===================================================================== */
+
+static bool BeginsBefore(const TSegment* a, const TSegment* b)
+{
+  return a->begin < b->begin;
+}
+
+/* distinct lines of a set of segments in the window [b, e) of simulated time */
+static uint64_t Footprint(const vector<const TSegment*>& segs, uint64_t b, uint64_t e, vector<int64_t>& buf)
+{
+  buf.clear();
+  for(size_t k=0; k<segs.size(); k++) {
+    const TSegment* seg = segs[k];
+    const TTask& t = gTasks[seg->task];
+
+    /* the share of the task's work in the window */
+    uint64_t from = seg->done + (max(b, seg->begin) - seg->begin);
+    uint64_t to = seg->done + (min(e, seg->end) - seg->begin);
+    if ( to <= from ) continue;
+
+    for(size_t l=0; l<t.lines.size(); l++) {
+      if ( (uint64_t)t.first[l] < to && (uint64_t)t.last[l] >= from ) buf.push_back(t.lines[l]);
+    }
+  }
+  sort(buf.begin(), buf.end());
+  return unique(buf.begin(), buf.end()) - buf.begin();
+}
+
+/* footprint of each consecutive window of length ws, segs sorted by begin */
+static void WindowFootprints(const vector<const TSegment*>& segs, uint64_t ws, uint64_t makespan,
+                             vector<uint64_t>& fps, vector<int64_t>& buf)
+{
+  vector<const TSegment*> active;
+  size_t next = 0;
+
+  fps.clear();
+  for(uint64_t b=0; b+ws<=makespan; b+=ws) {
+
+    /* drop the segments ended before the window */
+    size_t k = 0;
+    for(size_t j=0; j<active.size(); j++) {
+      if ( active[j]->end > b ) active[k++] = active[j];
+    }
+    active.resize(k);
+
+    /* add the segments beginning in the window */
+    for(; next<segs.size() && segs[next]->begin < b+ws; next++) {
+      if ( segs[next]->end > b ) active.push_back(segs[next]);
+    }
+
+    fps.push_back(Footprint(active, b, b+ws, buf));
+  }
+}
+
+void ReportFootprint(ostream& out, const string& name, int workers, uint64_t makespan,
+                     const vector<TSegment>& segments, int lowest, int linesize)
+{
+  vector<vector<const TSegment*> > per_worker(workers);
+  vector<const TSegment*> all;
+  for(size_t k=0; k<segments.size(); k++) {
+    per_worker[segments[k].worker].push_back(&segments[k]);
+    all.push_back(&segments[k]);
+  }
+  sort(all.begin(), all.end(), BeginsBefore);
+  for(int i=0; i<workers; i++) {
+    sort(per_worker[i].begin(), per_worker[i].end(), BeginsBefore);
+  }
+
+  vector<int64_t> buf;
+
+  out << "# policy " << name << " workers " << workers << " makespan " << makespan << endl;
+  out << "# whole run footprint:";
+  for(int i=0; i<workers; i++) {
+    out << " " << Footprint(per_worker[i], 0, makespan, buf) * linesize;
+  }
+  out << " aggregate " << Footprint(all, 0, makespan, buf) * linesize << endl;
+  out << "ws\taggregate\tcore_mean\tcore_max" << endl;
+
+  vector<uint64_t> agg;
+  vector<vector<uint64_t> > core(workers);
+
+  for(uint64_t ws=(uint64_t)1<<lowest; ws<=makespan; ws<<=1) {
+
+    WindowFootprints(all, ws, makespan, agg, buf);
+    for(int i=0; i<workers; i++) {
+      WindowFootprints(per_worker[i], ws, makespan, core[i], buf);
+    }
+
+    /* average over windows; mean and max are taken over the cores of each window */
+    double agg_sum = 0, mean_sum = 0, max_sum = 0;
+    for(size_t b=0; b<agg.size(); b++) {
+      uint64_t max = 0;
+      agg_sum += agg[b];
+      for(int i=0; i<workers; i++) {
+        mean_sum += 1.0 * core[i][b] / workers;
+        if ( core[i][b] > max ) max = core[i][b];
+      }
+      max_sum += max;
+    }
+
+    out << ws << "\t" << setprecision(12) << agg_sum / agg.size() * linesize
+        << "\t" << mean_sum / agg.size() * linesize 
+        << "\t" << max_sum / agg.size() * linesize << endl;
+  }
+  out << endl;
+}
+
+/* ===================================================================== */
+/* main */
+/* ===================================================================== */
+
+static int Usage(const char* prog)
+{
+  cerr << "usage: " << prog << " -f profile [-w workers] [-s bf,wf,hf,la] [-l lowest_window_log] [-r seed]" << endl;
+  return -1;
+}
+
+int main(int argc, char* argv[])
+{
+  string profile;
+  string policies = "bf,wf,hf,la";
+  int workers = 4;
+  int lowest = 10;
+  unsigned seed = 1;
+  int c;
+
+  while ( (c = getopt(argc, argv, "f:w:s:l:r:")) != -1 ) {
+    switch (c) {
+      case 'f': profile = optarg; break;
+      case 'w': workers = atoi(optarg); break;
+      case 's': policies = optarg; break;
+      case 'l': lowest = atoi(optarg); break;
+      case 'r': seed = atoi(optarg); break;
+      default: return Usage(argv[0]);
+    }
+  }
+  if ( profile.empty() || workers < 1 ) return Usage(argv[0]);
+
+  if ( !ReadTrace(profile) ) return -1;
+
+  const char* names[] = {"bf", "wf", "hf", "la"};
+  for(int p=POLICY_BF; p<=POLICY_LA; p++) {
+    if ( policies.find(names[p]) == string::npos ) continue;
+
+    TScheduleSim sim((TPolicy)p, workers, seed);
+    uint64_t makespan = sim.run();
+    ReportFootprint(cout, names[p], workers, makespan, sim.get_segments(), lowest, 64);
+  }
+
+  return 0;
+}
@@ -1,5 +1,9 @@
 #include <iostream>
+#include <fstream>
+#include <iomanip>
 #include <stdlib.h>
+#include <vector>
+#include <algorithm>
 
 #include "pin.H"
 #include "portability.H"
@@ -7,50 +11,145 @@
 #include "common.H"
 #include "rdtsc.H"
 #include "atomic.H"
-#include "sfp_list.H"
 #include "sfp_tokens.H"
 #include "sfp_stamp_table.H"
 #include "sfp_locality_desc.H"
+#include "sfp_profile.H"
+#include "sfp_runtime.H"
 #include "thread_support_scheduler.H"
 
 using namespace std;
 
+/* ===================================================================== */
+/* Knobs */
+/* ===================================================================== */
+
+/* knob of token set footprint output file */
+KNOB<string> KnobResultFile(KNOB_MODE_WRITEONCE, "pintool",
+			    "o", "tsfp.out", "specify token set footprint file name");
+
+/* knob of binary locality descriptor profile */
+KNOB<string> KnobProfileFile(KNOB_MODE_WRITEONCE, "pintool",
+			     "b", "ldesc.bin", "specify binary locality descriptor profile name");
+
+/* knob of token statistics output file */
+KNOB<string> KnobTokenStatFile(KNOB_MODE_WRITEONCE, "pintool",
+			       "s", "tokens.out", "specify token statistics file name");
+
+/* knob of token pool size */
+KNOB<int> KnobTokens(KNOB_MODE_WRITEONCE, "pintool",
+		     "t", "8", "specify the initial number of tokens, the pool grows up to MAX_TOKENS");
+
+/* knob of task parallel runtimes to detect task boundaries in */
+KNOB<string> KnobRuntime(KNOB_MODE_WRITEONCE, "pintool",
+			 "r", "auto", "specify runtimes to hook: auto, none, or a list of gomp, tbb, cilk");
+
+/* knob of per instruction attribution */
+KNOB<BOOL> KnobPc(KNOB_MODE_WRITEONCE, "pintool",
+		  "pc", "0", "attribute the shared accesses and first touches to instructions");
+
+/* knob of the per instruction report file */
+KNOB<string> KnobPcFile(KNOB_MODE_WRITEONCE, "pintool",
+			"pc_o", "pc.out", "specify the per instruction report file name");
+
+/* knob of the number of reported instructions */
+KNOB<UINT32> KnobPcTop(KNOB_MODE_WRITEONCE, "pintool",
+		       "pc_top", "100", "number of instructions with the most shared accesses to report");
+
+/* knob of task trace recording */
+KNOB<BOOL> KnobTaskTrace(KNOB_MODE_WRITEONCE, "pintool",
+			 "trace", "0", "record the task DAG and per-task line sets for sfp-schedsim");
+
+/* knob of the shortest window length in log scale */
+KNOB<int> KnobLowestLength(KNOB_MODE_WRITEONCE, "pintool",
+			   "l", "24", "specify the shortest window length in log scale");
+
+/* knob of window length step in log scale */
+KNOB<int> KnobLengthStep(KNOB_MODE_WRITEONCE, "pintool",
+			 "p", "1", "specify the window length step in log scale");
+
 struct TSFPListEntry {
   TStamp time;
-  THREADID id;
+  TToken token;
 };
 
-class TSFPList : public TList<TSFPListEntry>
+/* the latest access of every token to a datum, most recent first,
+ * only the tokens that accessed the datum take space
+ */
+class TSFPList : public vector<TSFPListEntry>
 {
 public:
   
-  void update(TToken token, TStamp now, TTaskDesc* td, UINT32 type)
+  /* returns true if it is the first access of the token to the datum */
+  bool update(TToken token, TStamp now, TTaskDesc* td, UINT32 type)
   {
-    TLocalityDesc& ld = td->ldesc;
-    /* TODO profiling */
-
-    TBitset bitset = 0;
-    TSFPList::Iterator curr;
-    for(curr=begin(); !is_end(curr); curr = next(curr))
-    {
-      TSFPListEntry e = get(curr);
-      TStamp len = now - e.time;
-      bitset |= (1<<curr);
-      ld.add(bitset, len, 1);
+    /* the windows closed by this access are accounted to the accessing task */
+    profile(td->ldesc, now);
+
+    /* move the token to the front with its latest access time */
+    size_t own = 0;
+    while ( own < size() && (*this)[own].token != token ) own++;
+
+    if ( own == size() ) {
+      TSFPListEntry e;
+      e.time = now;
+      e.token = token;
+      insert(begin(), e);
+      return true;
     }
-  
-    TSFPListEntry e;
-    e.time = now;
-    set_at(token, e);
-    set_front(token);
-  
-/*
-    if ( type == MEMOP_WRITE )
+
+    (*this)[own].time = now;
+    rotate(begin(), begin() + own, begin() + own + 1);
+    return false;
+  }
+
+  /* profile the windows whose right end lies between the latest access
+   * to this datum and now, for each window length in the descriptor.
+   * The logic is the same as the pillar profiling in anyset-fp.
+   */
+  void profile(TLocalityDesc& ld, TStamp now)
+  {
+    for(int i=0; i<LOCALITY_DESC_MAX_INDEX && now>TLocalityDesc::get_length(i); i++)
     {
-      latest_write_time = now;
-      latest_writer = token;
+      TStamp len = TLocalityDesc::get_length(i);
+      TBitset bitset = 0;
+
+      /* high is the right most point a window's left end could reach */
+      TStamp high = now - len;
+      /* low is the left most point a window's left end could reach */
+      TStamp low = 0;
+      if ( !empty() && front().time > len )
+      {
+        low = front().time - len;
+      }
+
+      TStamp rpoint = high;
+      for(const_iterator curr = begin(); curr != end(); curr++)
+      {
+        TStamp c = curr->time;
+
+        /* c > high means all these windows must contain token 'curr' */
+        if ( c > high )
+        {
+          bitset |= ((TBitset)1<<curr->token);
+          continue;
+        }
+
+        /* windows left of low can not contain following tokens */
+        if ( c <= low )
+        {
+          break;
+        }
+
+        /* the windows with left end in (c, rpoint] have sharer set bitset */
+        ld.add_at(bitset, i, rpoint-c);
+
+        rpoint = c;
+        bitset |= ((TBitset)1<<curr->token);
+      }
+
+      ld.add_at(bitset, i, rpoint-low);
     }
-*/
   }
 
 };
@@ -68,6 +167,23 @@ TStampTblManager<TSFPList> gStampTblMgr;
 /* global locality description */
 TLocalityDesc gLocalityDesc;
 
+/* window lengths of locality descriptors */
+TStamp TLocalityDesc::lengths[LOCALITY_DESC_MAX_INDEX];
+int TLocalityDesc::lowest;
+int TLocalityDesc::step;
+
+/* time stamp at program start, all time stamps are relative to it */
+TStamp gStartTime = 0;
+
+/* length of the profiled run in cycles */
+TStamp N = 0;
+
+/* record the task trace */
+bool gTaskTrace = false;
+
+/* the application marks its tasks with SFP_TaskStart and SFP_TaskEnd */
+bool gUserMarkers = false;
+
 /* ===================================================================== */
 /* Routines */
 /* ===================================================================== */
@@ -80,45 +196,62 @@ VOID InstructionExec(THREADID tid, VOID* ip, VOID* addr, UINT32 size, ADDRINT sp
   }
 
   local_stat_t* tdata = get_tls(tid);
-  if (tdata->is_taskid_inspect_enabled())
+  if ( !tdata->is_taskid_inspect_enabled() )
+  {
+    return;
+  }
+
+  unsigned int taskid = tdata->current_taskid();
+  TTaskDesc* td = tdata->cached_task(taskid);
+
+  /* only go to the token manager when the thread switches task */
+  if ( td == NULL )
   {
-    unsigned int taskid = tdata->current_taskid();
-     
     gTokenMgr.ReadLock();
-    if ( gTokenMgr.is_task_running(taskid) ) {
+    td = gTokenMgr.find_task_descriptor(taskid);
+    gTokenMgr.Unlock();
 
-      TTaskDesc* td = gTokenMgr.get_task_descriptor(taskid);
+    if ( td == NULL ) return;
+    tdata->cache_task(td);
+  }
 
-      /* release token manager lock after obtaining the task descriptor */
-      gTokenMgr.Unlock();
+  /* if current task is not running (in TaskStart and TaskEnd region) right now */
+  if ( !td->is_instrument_enabled() )
+  {
+    return;
+  }
 
-      TToken current_token = td->token;
+  TToken current_token = td->token;
+  td->accesses++;
 
-      /* the base address aligned at cache line boundary */
-      ADDRINT base_addr = gStampTblMgr.get_base_addr((ADDRINT)addr);
-      
-      /* the index of set in stamp table */
-      ADDRINT set_idx = gStampTblMgr.get_index(base_addr);
+  /* the base address aligned at cache line boundary */
+  ADDRINT base_addr = gStampTblMgr.get_base_addr((ADDRINT)addr);
 
-      /* reserve the lock for entry in stamp table before recording time stamp */
-      gStampTblMgr.Lock(set_idx);
+  if ( gTaskTrace )
+  {
+    td->record_line(base_addr, td->accesses - 1);
+  }
+  
+  /* the index of set in stamp table */
+  ADDRINT set_idx = gStampTblMgr.get_index(base_addr);
 
-      /* update time stamp info for the entry  */
-      TSFPList& s = gStampTblMgr.get_stamp_list(set_idx, base_addr);
+  /* reserve the lock for entry in stamp table before recording time stamp */
+  gStampTblMgr.Lock(set_idx);
 
-      /* update record */
-      s.update(current_token, SFP_RDTSC(), td, type);
+  /* update time stamp info for the entry  */
+  TSFPList& s = gStampTblMgr.get_stamp_list(set_idx, base_addr);
 
-      /* release lock */
-      gStampTblMgr.Unlock(set_idx);
-      
-      return;
-    }
+  /* update record */
+  bool first = s.update(current_token, SFP_RDTSC() - gStartTime, td, type);
 
-    /* if current task is not running (in TaskStart and TaskEnd region) right now */
-    gTokenMgr.Unlock();
-    
+  /* the tokens that have accessed the datum, for the per instruction attribution */
+  if ( KnobPc.Value() )
+  {
+    PC_Record(tdata->pcs.lookup((ADDRINT)ip), s.size(), first, type == MEMOP_WRITE);
   }
+
+  /* release lock */
+  gStampTblMgr.Unlock(set_idx);
 } 
 
 /* =================================================
@@ -187,17 +320,16 @@ LOCALFUN VOID Instruction(INS ins, void* v) {
 //
 void BeforeTaskStart(unsigned int own_id, unsigned int parent_id) {
   TTaskDesc* own_td;
-  TToken parent_token;
 
   gTokenMgr.WriteLock();
   own_td = gTokenMgr.get_task_descriptor(own_id);
-  parent_token = own_td->parent;
-  gTokenMgr.get_token(own_td, parent_token);
   gTokenMgr.Unlock();
 
   own_td->parent = parent_id;
+  gTokenMgr.get_token(own_td);
+
+  own_td->start_time = SFP_RDTSC() - gStartTime;
   own_td->enable_instrument();
-  own_td->start_time = SFP_RDTSC();
 
 }
 
@@ -208,16 +340,31 @@ void BeforeTaskEnd(unsigned int tid) {
 
   gTokenMgr.WriteLock();
   TTaskDesc* td = gTokenMgr.get_task_descriptor(tid);
-  TToken token = td->token; 
-  gTokenMgr.release_token(token, tid);
   gTokenMgr.Unlock();
  
-  td->end_time = SFP_RDTSC();
-  td->times.push_back(std::make_pair(td->start_time, td->end_time));
   td->disable_instrument();
+  td->end_time = SFP_RDTSC() - gStartTime;
+  td->times.push_back(std::make_pair(td->start_time, td->end_time));
+
+  gTokenMgr.release_token(td, td->end_time);
 
 }
 
+//
+// The replacing routine for SFP_TaskWait, the task waits for the
+// children it started so far
+//
+void BeforeTaskWait(unsigned int taskid) {
+
+  if ( !gTaskTrace ) return;
+
+  gTokenMgr.ReadLock();
+  TTaskDesc* td = gTokenMgr.find_task_descriptor(taskid);
+  gTokenMgr.Unlock();
+
+  if ( td ) td->waits.push_back(SFP_RDTSC() - gStartTime);
+}
+
 void StoreTaskIDAddr(const void* taskid_addr)
 {
   local_stat_t* ldata = get_tls(PIN_ThreadId());
@@ -225,6 +372,43 @@ void StoreTaskIDAddr(const void* taskid_addr)
   ldata->enable_taskid_inspect();
 }
 
+//
+// Task start detected by the runtime adapters in sfp_runtime.H
+//
+VOID RuntimeTaskStart(THREADID tid, unsigned int taskid, unsigned int parent)
+{
+  /* user markers take precedence over runtime detection */
+  if ( gUserMarkers ) return;
+
+  local_stat_t* ldata = get_tls(tid);
+  if ( !ldata->is_taskid_inspect_enabled() )
+  {
+    ldata->set_taskid_ptr(RT_CurrentTaskIdAddr(tid));
+    ldata->enable_taskid_inspect();
+  }
+  BeforeTaskStart(taskid, parent);
+}
+
+//
+// Task end detected by the runtime adapters in sfp_runtime.H
+//
+VOID RuntimeTaskEnd(THREADID tid, unsigned int taskid)
+{
+  if ( gUserMarkers ) return;
+
+  BeforeTaskEnd(taskid);
+}
+
+//
+// Task wait detected by the runtime adapters in sfp_runtime.H
+//
+VOID RuntimeTaskWait(THREADID tid, unsigned int taskid)
+{
+  if ( gUserMarkers ) return;
+
+  BeforeTaskWait(taskid);
+}
+
 //
 // Replacing SFP_TaskStart and SFP_TaskEnd to
 // get the user provided task id
@@ -244,15 +428,174 @@ VOID ImageLoad( IMG img, VOID* v) {
       RTN_Replace(start_rtn, AFUNPTR(BeforeTaskStart));
       RTN_Replace(end_rtn,   AFUNPTR(BeforeTaskEnd));
       RTN_Replace(taskid_rtn,AFUNPTR(StoreTaskIDAddr));
+      gUserMarkers = true;
+
+      /* the wait marker is optional */
+      RTN wait_rtn = RTN_FindByName( img, "SFP_TaskWait" );
+      if ( RTN_Valid(wait_rtn) ) RTN_Replace(wait_rtn, AFUNPTR(BeforeTaskWait));
     }
 
   }
 }
 
+//
+// helper routine in Fini
+// to collect the windows with right end at the end of trace
+//
+LOCALFUN VOID CollectLastAccesses() {
+
+  for(int i=0; i<gStampTblMgr.get_total_sets(); i++) {
+
+    map<ADDRINT, TSFPList>& set = gStampTblMgr.get_set(i);
+    for(map<ADDRINT, TSFPList>::iterator iter = set.begin(); iter != set.end(); iter++) {
+      iter->second.profile(gLocalityDesc, N+1);
+    }
+  }
+}
+
+//
+// routine for dumping the per-task and aggregated locality
+// descriptors in binary profile format
+//
+LOCALFUN VOID DumpLocalityDesc() {
+
+  TProfileWriter writer;
+  if ( !writer.open(KnobProfileFile.Value(), N, gThreadNum) ) {
+    cerr << "can not open " << KnobProfileFile.Value() << endl;
+    return;
+  }
+
+  writer.write_section(SECTION_LDESC_LENGTHS, 0, 1, LOCALITY_DESC_MAX_INDEX,
+                       (const INT64*)TLocalityDesc::get_lengths());
+  vector<INT64> rows;
+  gLocalityDesc.rows(rows);
+  writer.write_section(SECTION_LDESC_GLOBAL, 0, gLocalityDesc.size(), 1 + LOCALITY_DESC_MAX_INDEX,
+                       rows.empty() ? NULL : &rows[0]);
+
+  for(TTokenManager::TaskIterator i = gTokenMgr.tasks_begin(); i != gTokenMgr.tasks_end(); i++) {
+    TTaskDesc* td = i->second;
+    td->ldesc.rows(rows);
+    writer.write_section(SECTION_LDESC_TASK, td->taskid, td->ldesc.size(), 1 + LOCALITY_DESC_MAX_INDEX,
+                         rows.empty() ? NULL : &rows[0]);
+  }
+
+  if ( gTaskTrace ) {
+
+    /* the task DAG, one row per task */
+    vector<INT64> dag;
+    UINT64 tasks = 0;
+    for(TTokenManager::TaskIterator i = gTokenMgr.tasks_begin(); i != gTokenMgr.tasks_end(); i++) {
+      TTaskDesc* td = i->second;
+      dag.push_back(td->taskid);
+      dag.push_back(td->parent);
+      dag.push_back(td->token);
+      dag.push_back(td->start_time);
+      dag.push_back(td->end_time);
+      dag.push_back(td->accesses);
+      tasks++;
+    }
+    writer.write_section(SECTION_TASK_DAG, 0, tasks, TASK_DAG_COLS, dag.empty() ? NULL : &dag[0]);
+
+    /* the lines each task touched, in address order */
+    for(TTokenManager::TaskIterator i = gTokenMgr.tasks_begin(); i != gTokenMgr.tasks_end(); i++) {
+      TTaskDesc* td = i->second;
+      if ( td->lines.empty() ) continue;
+
+      vector<INT64> lines;
+      for(map<ADDRINT, pair<UINT64, UINT64> >::iterator l = td->lines.begin(); l != td->lines.end(); l++) {
+        lines.push_back(l->first);
+        lines.push_back(l->second.first);
+        lines.push_back(l->second.second);
+      }
+      writer.write_section(SECTION_TASK_LINES, td->taskid, td->lines.size(), TASK_LINES_COLS, &lines[0]);
+    }
+
+    /* the points each task waited for its children */
+    for(TTokenManager::TaskIterator i = gTokenMgr.tasks_begin(); i != gTokenMgr.tasks_end(); i++) {
+      TTaskDesc* td = i->second;
+      if ( td->waits.empty() ) continue;
+
+      vector<INT64> waits(td->waits.begin(), td->waits.end());
+      writer.write_section(SECTION_TASK_WAITS, td->taskid, waits.size(), 1, &waits[0]);
+    }
+  }
+
+  writer.close();
+}
+
+//
+// routine for dumping the footprint of each token set,
+// both the exclusively and the commonly accessed data
+//
+LOCALFUN VOID DumpTokenSetFootprint() {
+
+  ofstream ResultFile(KnobResultFile.Value().c_str());
+  ResultFile << dec << "N:" << N << " Threads: " << gThreadNum << endl;
+  ResultFile << "ws	set	exact	shared" << endl;
+
+  /* the token sets are as wide as the pool grew */
+  int tokens = gTokenMgr.get_pool_size();
+
+  for(int j=0; j<LOCALITY_DESC_MAX_INDEX; j++) {
+
+    /* don't need to dump windows longer than N */
+    if ( TLocalityDesc::get_length(j) > N ) break;
+
+    /* the sets that occur, the shared footprint of other sets is that of their supersets */
+    for(TLocalityDesc::Iterator i = gLocalityDesc.begin(); i != gLocalityDesc.end(); i++) {
+
+      TBitset b = i->first;
+      if ( b == 0 ) continue;
+
+      double exact = gLocalityDesc.exact_fp(b, j, N);
+      double shared = gLocalityDesc.shared_fp(b, j, N);
+      if ( shared == 0 ) continue;
+
+      /* token set printed as a bit string, lowest token first */
+      char buffer[MAX_TOKENS+1];
+      for(int k=0; k<tokens; k++) {
+        buffer[k] = ((b>>k)&1) + '0';
+      }
+      buffer[tokens] = '\0';
+
+      ResultFile << TLocalityDesc::get_length(j) << "\t" << buffer 
+                 << "\t" << setprecision(12) << exact * gStampTblMgr.WordWidth
+                 << "\t" << setprecision(12) << shared * gStampTblMgr.WordWidth << endl;
+    }
+  }
+
+  ResultFile.close();
+}
+
 //
 // Fini routine, called at application exit
 //
 VOID Fini(INT32 code, VOID* v) {
+
+  N = SFP_RDTSC() - gStartTime;
+
+  /* collect the windows left over at trace end */
+  CollectLastAccesses();
+
+  /* aggregate the per-task descriptors */
+  for(TTokenManager::TaskIterator i = gTokenMgr.tasks_begin(); i != gTokenMgr.tasks_end(); i++) {
+    gLocalityDesc += i->second->ldesc;
+  }
+
+  DumpLocalityDesc();
+  DumpTokenSetFootprint();
+
+  /* the instructions creating the shared footprint */
+  if ( KnobPc.Value() ) {
+    vector<const pc_table*> tables;
+    for(unsigned int t=0; t<gThreadNum; t++) tables.push_back(&get_tls(t)->pcs);
+    PC_WriteReport(KnobPcFile.Value(), tables, KnobPcTop.Value());
+  }
+
+  ofstream TokenStatFile(KnobTokenStatFile.Value().c_str());
+  gTokenMgr.dump_token_stats(TokenStatFile);
+  TokenStatFile.close();
+
   gTokenMgr.dump_taskdesc(std::cout);
 }
 
@@ -290,11 +633,25 @@ int main(int argc, char *argv[])
     PIN_AddThreadFiniFunction(ThreadFini, 0);
     PIN_AddFiniFunction(Fini, 0);
     IMG_AddInstrumentFunction(ImageLoad, 0);
+
+    /* hook task parallel runtimes for programs without markers */
+    RT_Activate(RT_ParseKinds(KnobRuntime.Value()), RuntimeTaskStart, RuntimeTaskEnd, RuntimeTaskWait);
     INS_AddInstrumentFunction(Instruction,0);
 
     /* init thread hooks, implemented in thread_support.H */
     ThreadInit();
 
+    gTaskTrace = KnobTaskTrace.Value();
+
+    /* setup the token pool */
+    gTokenMgr.set_pool_size(KnobTokens.Value());
+
+    /* setup the window lengths of locality descriptors */
+    TLocalityDesc::init(KnobLowestLength.Value(), KnobLengthStep.Value());
+
+    /* all time stamps are relative to program start */
+    gStartTime = SFP_RDTSC();
+
     // Never returns
     PIN_StartProgram();
     